@@ -0,0 +1,30 @@
+#include <cstdlib>
+
+#include "pyramid.benchmark.hpp"
+
+
+int main(int argc, char* argv[]) {
+    auto const elements = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1ull << 17;
+    if(elements == 0) {
+        std::fprintf(stderr, "usage: %s [elements]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    using namespace pyramid_benchmark;
+    run<pyramid_adapter<order>,
+        pyramid_adapter<order, etceteras::pyramid_layout::compact>,
+        pyramid_adapter<order, etceteras::pyramid_layout::interleaved, etceteras::pyramid_reuse::address_order>,
+        pyramid_adapter<order, etceteras::pyramid_layout::interleaved, etceteras::pyramid_reuse::densest_page>,
+        pyramid_handle_adapter<order>,
+        pyramid_interleaved_adapter<order>,
+        pyramid_unordered_adapter<order>,
+        pyramid_unordered_adapter<order, etceteras::pyramid_layout::split>,
+        unordered_pyramid_adapter<order>,
+        list_adapter<order>,
+        deque_adapter<order>,
+        slot_map_adapter<order>>(static_cast<std::size_t>(elements));
+    run_threaded<locked_pyramid_adapter<order>,
+                 concurrent_pyramid_adapter<order>,
+                 sharded_pyramid_adapter<order>>(static_cast<std::size_t>(elements));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,716 @@
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <etceteras/concurrent_pyramid.hpp>
+#include <etceteras/epoch_pyramid.hpp>
+#include <etceteras/parallel_pyramid.hpp>
+#include <etceteras/pyramid.hpp>
+#include <etceteras/sharded_pyramid.hpp>
+#include <etceteras/unordered_pyramid.hpp>
+
+
+namespace pyramid_benchmark {
+
+
+    using clock = std::chrono::steady_clock;
+
+
+    inline std::uint64_t elapsed_ns(clock::time_point started) noexcept {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - started).count());
+    }
+
+
+    struct order {
+        std::uint64_t id;
+        std::uint64_t price;
+        std::uint64_t quantity;
+        std::uint64_t flags;
+    }; // order
+
+
+    inline order make_order(std::uint64_t id) noexcept {
+        return order{id, id * 7, id & 0xFF, 0};
+    }
+
+
+    // Cheap generator so that picking victims does not dominate timings
+    class xorshift {
+        std::uint64_t state_;
+
+    public:
+        explicit xorshift(std::uint64_t seed) noexcept: state_{seed} { }
+
+        std::uint64_t operator () () noexcept {
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 7;
+            state_ ^= state_ << 17;
+            return state_;
+        }
+
+        std::size_t below(std::size_t n) noexcept {
+            return static_cast<std::size_t>((*this)() % n);
+        }
+    }; // xorshift
+
+
+    class latencies {
+        std::vector<std::uint64_t> samples_;
+
+    public:
+
+        void reserve(std::size_t n) {
+            samples_.reserve(n);
+        }
+
+
+        void add(std::uint64_t ns) {
+            samples_.push_back(ns);
+        }
+
+
+        std::uint64_t percentile(double p) {
+            if(samples_.empty())
+                return 0;
+            auto const n = static_cast<std::size_t>(p * double(samples_.size() - 1));
+            std::nth_element(samples_.begin(), samples_.begin() + n, samples_.end());
+            return samples_[n];
+        }
+    }; // latencies
+
+
+    template<typename T,
+             typename L = etceteras::pyramid_layout::interleaved,
+             etceteras::pyramid_reuse R = etceteras::pyramid_reuse::lifo>
+    class pyramid_adapter {
+        using container = etceteras::pyramid<T, 16, etceteras::pyramid_growth::geometric<16>, std::allocator<T>, L>;
+        container items_;
+
+    public:
+        using handle = typename container::iterator;
+        static constexpr char const* name =
+            R == etceteras::pyramid_reuse::address_order ? "pyramid by address"
+            : R == etceteras::pyramid_reuse::densest_page ? "pyramid densest"
+            : std::is_same_v<L, etceteras::pyramid_layout::compact> ? "pyramid compact" : "pyramid";
+
+        pyramid_adapter() { items_.reuse_policy(R); }
+
+        handle insert(T const& item) { return items_.insert(item); }
+        void erase(handle h) { items_.erase(h); }
+        void clear() { items_.clear(); }
+
+        template<typename F> void for_each(F&& f) const {
+            for(auto const& item: items_)
+                f(item);
+        }
+    }; // pyramid_adapter
+
+
+    // Scans pages by occupancy bitmaps instead of following insertion order
+    template<typename T, typename L = etceteras::pyramid_layout::interleaved>
+    class pyramid_unordered_adapter {
+        using container = etceteras::pyramid<T, 16, etceteras::pyramid_growth::geometric<16>, std::allocator<T>, L>;
+        container items_;
+
+    public:
+        using handle = typename container::iterator;
+        static constexpr char const* name =
+            std::is_same_v<L, etceteras::pyramid_layout::split> ? "pyramid split" : "pyramid unordered";
+
+        handle insert(T const& item) { return items_.insert(item); }
+        void erase(handle h) { items_.erase(h); }
+        void clear() { items_.clear(); }
+
+        template<typename F> void for_each(F&& f) const {
+            items_.for_each_unordered(f);
+        }
+    }; // pyramid_unordered_adapter
+
+
+    // Erases by generation checked handles instead of iterators
+    template<typename T>
+    class pyramid_handle_adapter {
+        using container = etceteras::pyramid<T, 16, etceteras::pyramid_growth::geometric<16>, std::allocator<T>,
+                                             etceteras::pyramid_layout::generational>;
+        container items_;
+
+    public:
+        using handle = etceteras::pyramid_handle;
+        static constexpr char const* name = "pyramid handles";
+
+        handle insert(T const& item) { return items_.handle_of(items_.insert(item)); }
+        void erase(handle h) { items_.erase(h); }
+        void clear() { items_.clear(); }
+
+        template<typename F> void for_each(F&& f) const {
+            for(auto const& item: items_)
+                f(item);
+        }
+    }; // pyramid_handle_adapter
+
+
+    // Follows several parts of insertion order at once
+    template<typename T>
+    class pyramid_interleaved_adapter {
+        using container = etceteras::pyramid<T>;
+        container items_;
+
+    public:
+        using handle = typename container::iterator;
+        static constexpr char const* name = "pyramid 8 chains";
+
+        handle insert(T const& item) { return items_.insert(item); }
+        void erase(handle h) { items_.erase(h); }
+        void clear() { items_.clear(); }
+
+        template<typename F> void for_each(F&& f) const {
+            items_.for_each_interleaved(f);
+        }
+    }; // pyramid_interleaved_adapter
+
+
+    template<typename T>
+    class unordered_pyramid_adapter {
+        etceteras::unordered_pyramid<T> items_;
+
+    public:
+        using handle = typename etceteras::unordered_pyramid<T>::iterator;
+        static constexpr char const* name = "unordered_pyramid";
+
+        handle insert(T const& item) { return items_.insert(item); }
+        void erase(handle h) { items_.erase(h); }
+        void clear() { items_.clear(); }
+
+        template<typename F> void for_each(F&& f) const {
+            for(auto const& item: items_)
+                f(item);
+        }
+    }; // unordered_pyramid_adapter
+
+
+    template<typename T>
+    class list_adapter {
+        std::list<T> items_;
+
+    public:
+        using handle = typename std::list<T>::iterator;
+        static constexpr char const* name = "std::list";
+
+        handle insert(T const& item) { return items_.insert(items_.end(), item); }
+        void erase(handle h) { items_.erase(h); }
+        void clear() { items_.clear(); }
+
+        template<typename F> void for_each(F&& f) const {
+            for(auto const& item: items_)
+                f(item);
+        }
+    }; // list_adapter
+
+
+    // Stable addresses via std::deque, erased slots are recycled through a free list
+    template<typename T>
+    class deque_adapter {
+        std::deque<std::optional<T>> slots_;
+        std::vector<std::size_t> free_slots_;
+
+    public:
+        using handle = std::size_t;
+        static constexpr char const* name = "std::deque+free";
+
+        handle insert(T const& item) {
+            if(free_slots_.empty()) {
+                slots_.emplace_back(item);
+                return slots_.size() - 1;
+            }
+            auto const slot = free_slots_.back();
+            free_slots_.pop_back();
+            slots_[slot].emplace(item);
+            return slot;
+        }
+
+        void erase(handle h) {
+            slots_[h].reset();
+            free_slots_.push_back(h);
+        }
+
+        void clear() {
+            slots_.clear();
+            free_slots_.clear();
+        }
+
+        template<typename F> void for_each(F&& f) const {
+            for(auto const& slot: slots_)
+                if(slot)
+                    f(*slot);
+        }
+    }; // deque_adapter
+
+
+    // Dense values with an indirection table, erase swaps with the last value
+    template<typename T>
+    class slot_map_adapter {
+        struct slot {
+            std::uint32_t index;
+            std::uint32_t generation;
+        };
+
+        std::vector<T> values_;
+        std::vector<std::uint32_t> owners_;
+        std::vector<slot> slots_;
+        std::vector<std::uint32_t> free_slots_;
+
+    public:
+        struct handle {
+            std::uint32_t slot;
+            std::uint32_t generation;
+        };
+        static constexpr char const* name = "slot map";
+
+        handle insert(T const& item) {
+            std::uint32_t key;
+            if(free_slots_.empty()) {
+                key = static_cast<std::uint32_t>(slots_.size());
+                slots_.push_back(slot{0, 0});
+            } else {
+                key = free_slots_.back();
+                free_slots_.pop_back();
+            }
+            slots_[key].index = static_cast<std::uint32_t>(values_.size());
+            values_.push_back(item);
+            owners_.push_back(key);
+            return handle{key, slots_[key].generation};
+        }
+
+        void erase(handle h) {
+            auto& erased = slots_[h.slot];
+            if(erased.generation != h.generation)
+                return;
+            auto const index = erased.index;
+            values_[index] = std::move(values_.back());
+            owners_[index] = owners_.back();
+            slots_[owners_[index]].index = index;
+            values_.pop_back();
+            owners_.pop_back();
+            ++erased.generation;
+            free_slots_.push_back(h.slot);
+        }
+
+        void clear() {
+            values_.clear();
+            owners_.clear();
+            slots_.clear();
+            free_slots_.clear();
+        }
+
+        template<typename F> void for_each(F&& f) const {
+            for(auto const& value: values_)
+                f(value);
+        }
+    }; // slot_map_adapter
+
+
+    // Keeps the optimizer from discarding visited elements
+    inline volatile std::uint64_t sink;
+
+
+    // Pyramid shared by threads behind one mutex
+    template<typename T>
+    class locked_pyramid_adapter {
+        using container = etceteras::pyramid<T, 16, etceteras::pyramid_growth::geometric<16>>;
+        std::mutex mutex_;
+        container items_;
+
+    public:
+        using handle = typename container::iterator;
+        static constexpr char const* name = "locked pyramid";
+
+        handle insert(T const& item) {
+            auto const lock = std::lock_guard<std::mutex>{mutex_};
+            return items_.insert(item);
+        }
+
+        void erase(handle h) {
+            auto const lock = std::lock_guard<std::mutex>{mutex_};
+            items_.erase(h);
+        }
+    }; // locked_pyramid_adapter
+
+
+    template<typename T>
+    class concurrent_pyramid_adapter {
+        using container = etceteras::concurrent_pyramid<T>;
+        container items_;
+
+    public:
+        using handle = T*;
+        static constexpr char const* name = "concurrent pyramid";
+
+        handle insert(T const& item) { return items_.insert(item); }
+        void erase(handle h) { items_.erase(h); }
+    }; // concurrent_pyramid_adapter
+
+
+    template<typename T>
+    class sharded_pyramid_adapter {
+        using container = etceteras::sharded_pyramid<T>;
+        container items_;
+
+    public:
+        using handle = typename container::iterator;
+        static constexpr char const* name = "sharded pyramid";
+
+        handle insert(T const& item) { return items_.insert(item); }
+        void erase(handle h) { items_.erase(h); }
+    }; // sharded_pyramid_adapter
+
+
+    inline void print_header(char const* workload, char const* throughput) {
+        std::printf("\n%-24s %-18s %12s %10s %10s %10s\n",
+                    workload, "container", throughput, "p50 ns", "p99 ns", "p99.9 ns");
+    }
+
+
+    template<class C>
+    void fill_and_fragment(C& container,
+                           std::vector<typename C::handle>& live,
+                           std::size_t elements,
+                           std::size_t survivors,
+                           xorshift& random) {
+        live.reserve(elements);
+        for(auto i = std::size_t{0}; i != elements; ++i)
+            live.push_back(container.insert(make_order(i)));
+        while(live.size() > survivors) {
+            auto const victim = random.below(live.size());
+            container.erase(live[victim]);
+            live[victim] = live.back();
+            live.pop_back();
+        }
+    }
+
+
+    // Alternates erase of a random live element with an insert, live set stays constant
+    template<class C>
+    void churn(std::size_t elements, double fill) {
+        auto container = C{};
+        auto live = std::vector<typename C::handle>{};
+        auto random = xorshift{0x9E3779B97F4A7C15ull};
+        auto const survivors = std::max<std::size_t>(1, std::size_t(double(elements) * fill));
+        fill_and_fragment(container, live, elements, survivors, random);
+
+        auto const operations = elements * 4;
+        auto next_id = std::uint64_t(elements);
+        auto const started = clock::now();
+        for(auto i = std::size_t{0}; i != operations; i += 2) {
+            auto const victim = random.below(live.size());
+            container.erase(live[victim]);
+            live[victim] = container.insert(make_order(next_id++));
+        }
+        auto const total_ns = elapsed_ns(started);
+
+        auto samples = latencies{};
+        samples.reserve(operations);
+        for(auto i = std::size_t{0}; i != operations; i += 2) {
+            auto const victim = random.below(live.size());
+            auto const erase_started = clock::now();
+            container.erase(live[victim]);
+            samples.add(elapsed_ns(erase_started));
+            auto const insert_started = clock::now();
+            live[victim] = container.insert(make_order(next_id++));
+            samples.add(elapsed_ns(insert_started));
+        }
+
+        std::printf("churn %3.0f%%               %-18s %12.2f %10llu %10llu %10llu\n",
+                    fill * 100., C::name,
+                    double(operations) * 1e3 / double(total_ns),
+                    static_cast<unsigned long long>(samples.percentile(0.5)),
+                    static_cast<unsigned long long>(samples.percentile(0.99)),
+                    static_cast<unsigned long long>(samples.percentile(0.999)));
+    }
+
+
+    // Full scan after several rounds of random erase/reinsert
+    template<class C>
+    void iterate_fragmented(std::size_t elements) {
+        auto container = C{};
+        auto live = std::vector<typename C::handle>{};
+        auto random = xorshift{0xD1B54A32D192ED03ull};
+        fill_and_fragment(container, live, elements, elements / 2, random);
+        auto next_id = std::uint64_t(elements);
+        for(auto round = 0; round != 4; ++round) {
+            while(live.size() != elements)
+                live.push_back(container.insert(make_order(next_id++)));
+            while(live.size() > elements / 2) {
+                auto const victim = random.below(live.size());
+                container.erase(live[victim]);
+                live[victim] = live.back();
+                live.pop_back();
+            }
+        }
+
+        auto const passes = 64;
+        auto samples = latencies{};
+        auto checksum = std::uint64_t{0};
+        auto const started = clock::now();
+        for(auto pass = 0; pass != passes; ++pass) {
+            auto const pass_started = clock::now();
+            container.for_each([&](order const& o) { checksum += o.price; });
+            samples.add(elapsed_ns(pass_started));
+        }
+        auto const total_ns = elapsed_ns(started);
+        sink = checksum;
+
+        std::printf("iterate fragmented       %-18s %12.2f %10llu %10llu %10llu\n",
+                    C::name,
+                    double(passes) * double(live.size()) * 1e3 / double(total_ns),
+                    static_cast<unsigned long long>(samples.percentile(0.5)),
+                    static_cast<unsigned long long>(samples.percentile(0.99)),
+                    static_cast<unsigned long long>(samples.percentile(0.999)));
+    }
+
+
+    // Teardown of a fragmented container, latencies are per whole run
+    template<class C>
+    void bulk_clear(std::size_t elements) {
+        auto const runs = 32;
+        auto samples = latencies{};
+        auto total_ns = std::uint64_t{0};
+        auto random = xorshift{0xA0761D6478BD642Full};
+        for(auto run = 0; run != runs; ++run) {
+            auto container = C{};
+            auto live = std::vector<typename C::handle>{};
+            fill_and_fragment(container, live, elements, elements * 3 / 4, random);
+            auto const started = clock::now();
+            container.clear();
+            auto const run_ns = elapsed_ns(started);
+            total_ns += run_ns;
+            samples.add(run_ns);
+        }
+
+        std::printf("bulk clear               %-18s %12.2f %10llu %10llu %10llu\n",
+                    C::name,
+                    double(runs) * double(elements * 3 / 4) * 1e3 / double(total_ns),
+                    static_cast<unsigned long long>(samples.percentile(0.5)),
+                    static_cast<unsigned long long>(samples.percentile(0.99)),
+                    static_cast<unsigned long long>(samples.percentile(0.999)));
+    }
+
+
+    // Every thread churns its own share of live elements in one shared container,
+    // returns millions of operations per second
+    template<class C>
+    double threaded_churn(std::size_t elements, unsigned threads) {
+        auto container = C{};
+        auto const operations = elements * 4 / threads;
+        auto workers = std::vector<std::thread>{};
+        auto const started = clock::now();
+        for(auto t = 0u; t != threads; ++t)
+            workers.emplace_back([&container, elements, threads, operations, t] {
+                auto random = xorshift{0x9E3779B97F4A7C15ull + t};
+                auto live = std::vector<typename C::handle>{};
+                auto next_id = std::uint64_t(t) << 40;
+                live.reserve(elements / threads);
+                while(live.size() != elements / threads)
+                    live.push_back(container.insert(make_order(next_id++)));
+                for(auto i = std::size_t{0}; i != operations; i += 2) {
+                    auto const victim = random.below(live.size());
+                    container.erase(live[victim]);
+                    live[victim] = container.insert(make_order(next_id++));
+                }
+                for(auto h: live)
+                    container.erase(h);
+            });
+        for(auto& worker: workers)
+            worker.join();
+        auto const total_ns = elapsed_ns(started);
+        return double(elements + operations * threads) * 1e3 / double(total_ns);
+    }
+
+
+    // Speedup of threaded churn over one thread should follow threads up to the number
+    // of cores, those falling below half of it are marked as contended
+    template<class C>
+    void threaded_scaling(std::size_t elements) {
+        auto const cores = std::max(1u, std::thread::hardware_concurrency());
+        auto single = 0.0;
+        for(auto const threads: {1u, 2u, 4u, 8u}) {
+            auto const throughput = threaded_churn<C>(elements, threads);
+            if(threads == 1)
+                single = throughput;
+            auto const speedup = throughput / single;
+            auto const contended = speedup < 0.5 * double(std::min(threads, cores));
+            std::printf("threads %-2u               %-18s %12.2f %10.2f %s\n",
+                        threads, C::name, throughput, speedup, contended ? "contended" : "");
+        }
+    }
+
+
+    // Pyramid behind reader-writer lock, scans hold it shared
+    template<typename T>
+    class shared_locked_pyramid_adapter {
+        using container = etceteras::pyramid<T, 16, etceteras::pyramid_growth::geometric<16>>;
+        mutable std::shared_mutex mutex_;
+        container items_;
+
+    public:
+        using handle = typename container::iterator;
+        static constexpr char const* name = "rw locked pyramid";
+
+        handle insert(T const& item) {
+            auto const lock = std::unique_lock<std::shared_mutex>{mutex_};
+            return items_.insert(item);
+        }
+
+        void erase(handle h) {
+            auto const lock = std::unique_lock<std::shared_mutex>{mutex_};
+            items_.erase(h);
+        }
+
+        template<typename F> void scan(F&& f) const {
+            auto const lock = std::shared_lock<std::shared_mutex>{mutex_};
+            for(auto const& item: items_)
+                f(item);
+        }
+    }; // shared_locked_pyramid_adapter
+
+
+    template<typename T>
+    class epoch_pyramid_adapter {
+        using container = etceteras::epoch_pyramid<T>;
+        container items_;
+
+    public:
+        using handle = typename container::iterator;
+        static constexpr char const* name = "epoch pyramid";
+
+        handle insert(T const& item) { return items_.insert(item); }
+        void erase(handle h) { items_.erase(h); }
+
+        template<typename F> void scan(F&& f) const {
+            items_.read().for_each(f);
+        }
+    }; // epoch_pyramid_adapter
+
+
+    // One writer churns while readers scan all the time, latencies are of writer
+    template<class C>
+    void scanned_churn(std::size_t elements, unsigned readers) {
+        auto container = C{};
+        auto live = std::vector<typename C::handle>{};
+        auto random = xorshift{0x9E3779B97F4A7C15ull};
+        live.reserve(elements);
+        for(auto i = std::size_t{0}; i != elements; ++i)
+            live.push_back(container.insert(make_order(i)));
+
+        auto stop = std::atomic<bool>{false};
+        auto scanners = std::vector<std::thread>{};
+        for(auto r = 0u; r != readers; ++r)
+            scanners.emplace_back([&container, &stop] {
+                auto checksum = std::uint64_t{0};
+                while(!stop.load(std::memory_order_relaxed))
+                    container.scan([&checksum](order const& o) { checksum += o.price; });
+                sink = checksum;
+            });
+
+        // Writers under lock wait for whole scans, so operations are few
+        auto const operations = std::min<std::size_t>(elements, 4096);
+        auto next_id = std::uint64_t(elements);
+        auto samples = latencies{};
+        samples.reserve(operations);
+        auto const started = clock::now();
+        for(auto i = std::size_t{0}; i != operations; ++i) {
+            auto const victim = random.below(live.size());
+            auto const operation_started = clock::now();
+            container.erase(live[victim]);
+            live[victim] = container.insert(make_order(next_id++));
+            samples.add(elapsed_ns(operation_started));
+        }
+        auto const total_ns = elapsed_ns(started);
+        stop = true;
+        for(auto& scanner: scanners)
+            scanner.join();
+
+        std::printf("readers %-2u               %-18s %12.2f %10llu %10llu %10llu\n",
+                    readers, C::name,
+                    double(operations) * 1e3 / double(total_ns),
+                    static_cast<unsigned long long>(samples.percentile(0.5)),
+                    static_cast<unsigned long long>(samples.percentile(0.99)),
+                    static_cast<unsigned long long>(samples.percentile(0.999)));
+    }
+
+
+    // Full scan of a fragmented pyramid split into page chunks among threads
+    inline void parallel_scan(std::size_t elements, unsigned threads) {
+        auto container = etceteras::pyramid<order>{};
+        for(auto i = std::size_t{0}; i != elements; ++i)
+            container.insert(make_order(i));
+        container.erase_if([](order const& o) { return o.id % 3 == 0; });
+
+        // Every item is recomputed in place, so threads share nothing but the pyramid
+        auto const passes = 64;
+        auto const started = clock::now();
+        for(auto pass = 0; pass != passes; ++pass) {
+            auto pool = etceteras::detail::parallel_threads{};
+            etceteras::parallel_for_each(container, [](order& o) {
+                o.flags = o.price * o.quantity;
+            }, pool, etceteras::parallel_grain, threads);
+        }
+        auto const total_ns = elapsed_ns(started);
+        sink = container.begin()->flags;
+
+        std::printf("threads %-2u               %-18s %12.2f\n",
+                    threads, "parallel for each",
+                    double(passes) * double(container.size()) * 1e3 / double(total_ns));
+    }
+
+
+    template<class... Containers>
+    void run_threaded(std::size_t elements) {
+        std::printf("\n%-24s %-18s %12s %10s\n", "threaded churn", "container", "Mops/s", "speedup");
+        ((threaded_scaling<Containers>(elements), std::printf("\n")), ...);
+
+        print_header("scanned churn (ns/pair)", "Mpairs/s");
+        for(auto const readers: {1u, 2u}) {
+            scanned_churn<shared_locked_pyramid_adapter<order>>(elements, readers);
+            scanned_churn<epoch_pyramid_adapter<order>>(elements, readers);
+            std::printf("\n");
+        }
+
+        std::printf("\n%-24s %-18s %12s\n", "parallel scan", "container", "Melements/s");
+        for(auto const threads: {1u, 2u, 4u, 8u})
+            parallel_scan(elements, threads);
+    }
+
+
+    template<class... Containers>
+    void run(std::size_t elements) {
+        std::printf("elements: %zu, element size: %zu bytes\n", elements, sizeof(order));
+
+        print_header("churn (ns/operation)", "Mops/s");
+        for(auto const fill: {0.25, 0.5, 0.9}) {
+            (churn<Containers>(elements, fill), ...);
+            std::printf("\n");
+        }
+
+        print_header("scan (ns/pass)", "Melements/s");
+        (iterate_fragmented<Containers>(elements), ...);
+
+        print_header("clear (ns/run)", "Melements/s");
+        (bulk_clear<Containers>(elements), ...);
+    }
+
+
+} // namespace pyramid_benchmark
@@ -0,0 +1,409 @@
+// This file is part of etceteras library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "pyramid.hpp"
+
+
+namespace etceteras {
+    
+    
+    namespace detail {
+        
+        // Node of concurrent pyramid, free node keeps links in place of destroyed item:
+        // the next node of its magazine and the next magazine of depot for the first one
+        template<typename T>
+        union concurrent_pyramid_slot {
+            concurrent_pyramid_slot() noexcept { }
+            ~concurrent_pyramid_slot() { }
+            T item;
+            struct {
+                concurrent_pyramid_slot* next_free;
+                concurrent_pyramid_slot* next_magazine;
+            } links;
+        }; // concurrent_pyramid_slot
+        
+        
+        // Page is aligned by its size and followed by occupancy bitmap and nodes.
+        // The bitmap is filled only when items are visited, out of free nodes
+        struct concurrent_pyramid_page {
+            concurrent_pyramid_page* next_page;
+            pyramid_size_type carved;
+        }; // concurrent_pyramid_page
+        
+        
+        // Test and test-and-set lock for short and rarely contended sections
+        class pyramid_spinlock {
+            std::atomic<bool> locked_{false};
+        
+        public:
+            
+            void lock() noexcept {
+                while(locked_.exchange(true, std::memory_order_acquire))
+                    while(locked_.load(std::memory_order_relaxed))
+                        std::this_thread::yield();
+            }
+            
+            void unlock() noexcept {
+                locked_.store(false, std::memory_order_release);
+            }
+        }; // pyramid_spinlock
+        
+        
+        // Numbers threads one by one as they ask for the first time
+        inline pyramid_size_type pyramid_thread_index() noexcept {
+            static std::atomic<pyramid_size_type> threads{0};
+            thread_local auto const index = threads.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+    
+    
+    } // namespace detail
+    
+    
+    // Pyramid for many threads without insertion order. Each thread takes free nodes
+    // from its own cache and puts erased ones there, caches exchange magazines of M nodes
+    // with shared depot, so threads rarely meet on the same lock. Pages of PageBytes
+    // are aligned by their size and kept until clear
+    template<typename T,
+             detail::pyramid_size_type M = 64,
+             detail::pyramid_size_type PageBytes = detail::pyramid_size_type{1} << 16,
+             typename A = std::allocator<T>>
+    class concurrent_pyramid {
+        
+        using node_type = detail::concurrent_pyramid_slot<T>;
+        using page_type = detail::concurrent_pyramid_page;
+        using word_type = detail::pyramid_size_type;
+        using page_block = detail::pyramid_page_block<PageBytes>;
+        using allocator_traits = std::allocator_traits<A>;
+        using page_allocator = typename allocator_traits::template rebind_alloc<page_block>;
+        using page_allocator_traits = std::allocator_traits<page_allocator>;
+        
+        static_assert(std::is_same_v<typename allocator_traits::value_type, T>,
+                      "Allocator should have the same value_type as concurrent_pyramid");
+        static_assert(std::is_pointer_v<typename page_allocator_traits::pointer>,
+                      "Allocators with fancy pointers are not supported");
+        static_assert(M > 0, "Magazine should hold at least one node");
+        static_assert((PageBytes & (PageBytes - 1)) == 0, "Page size should be a power of two");
+        
+        static detail::pyramid_size_type constexpr caches = 64;
+        
+        
+        static constexpr detail::pyramid_size_type nodes_offset(detail::pyramid_size_type capacity) noexcept {
+            auto const bitmap_end = sizeof(page_type) + detail::pyramid_words(capacity) * sizeof(word_type);
+            return (bitmap_end + alignof(node_type) - 1) / alignof(node_type) * alignof(node_type);
+        }
+        
+        
+        static constexpr detail::pyramid_size_type nodes_per_page() noexcept {
+            auto capacity = PageBytes / sizeof(node_type);
+            while(capacity != 0 && nodes_offset(capacity) + capacity * sizeof(node_type) > PageBytes)
+                --capacity;
+            return capacity;
+        }
+        
+        
+        // Thread takes nodes from loaded magazine and puts them back there. Full loaded
+        // magazine becomes previous one, and previous one goes to depot if there is one
+        struct alignas(detail::pyramid_cache_line) cache {
+            detail::pyramid_spinlock lock;
+            node_type* loaded{nullptr};
+            detail::pyramid_size_type loaded_size{0};
+            node_type* previous{nullptr};          // full magazine if any
+            std::atomic<std::ptrdiff_t> size{0};   // items inserted minus erased through cache
+        }; // cache
+        
+        
+        A allocator_;
+        cache caches_[caches];
+        std::mutex depot_mutex_;
+        node_type* depot_{nullptr};     // full magazines linked by their first nodes
+        page_type* pages_{nullptr};     // the last allocated one first, nodes are carved from it
+        std::atomic<detail::pyramid_size_type> capacity_{0};
+    
+    public:
+        
+        using size_type = detail::pyramid_size_type;
+        using value_type = T;
+        using allocator_type = A;
+        
+        static size_type constexpr magazine_size = M;
+        static size_type constexpr page_size = PageBytes;
+        static size_type constexpr page_capacity = nodes_per_page();
+        
+        static_assert(page_capacity != 0, "Page should fit at least one node");
+        
+        
+        concurrent_pyramid() noexcept(noexcept(A())): concurrent_pyramid(A()) { }
+        
+        
+        explicit concurrent_pyramid(A const& allocator) noexcept: allocator_{allocator} { }
+        
+        
+        concurrent_pyramid(concurrent_pyramid const&) = delete;
+        concurrent_pyramid& operator = (concurrent_pyramid const&) = delete;
+        
+        
+        ~concurrent_pyramid() {
+            clear();
+        }
+        
+        
+        allocator_type get_allocator() const noexcept {
+            return allocator_;
+        }
+        
+        
+        // Exact only while nothing is inserted or erased
+        size_type size() const noexcept {
+            auto size = std::ptrdiff_t{0};
+            for(auto const& c: caches_)
+                size += c.size.load(std::memory_order_relaxed);
+            return size_type(size);
+        }
+        
+        
+        size_type capacity() const noexcept {
+            return capacity_.load(std::memory_order_relaxed);
+        }
+        
+        
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+        
+        
+        T* insert(T const& item) {
+            return emplace(item);
+        }
+        
+        
+        T* insert(T&& item) {
+            return emplace(std::move(item));
+        }
+        
+        
+        // Constructs item in a node from the cache of calling thread,
+        // if constructor throws the node goes back there
+        template<typename... Args>
+        T* emplace(Args&&... args) {
+            auto& c = own_cache();
+            auto* node = take_node(c);
+            try {
+                allocator_traits::construct(allocator_, &node->item, std::forward<Args>(args)...);
+            } catch(...) {
+                put_node(c, node);
+                throw;
+            }
+            return &node->item;
+        }
+        
+        
+        // Any thread may erase any item, node goes to the cache of calling thread.
+        // Neither erase nor insert writes to memory shared with other threads but the node
+        void erase(T* item) noexcept {
+            auto* node = reinterpret_cast<node_type*>(item);
+            allocator_traits::destroy(allocator_, item);
+            put_node(own_cache(), node);
+        }
+        
+        
+        // Visits items page by page, nothing should be inserted or erased meanwhile.
+        // Occupancy is worked out first from carved nodes and free ones
+        template<typename Function>
+        void for_each(Function&& f) {
+            mark_occupied();
+            for(auto* page = pages_; page != nullptr; page = page->next_page) {
+                auto* const words = occupancy(page);
+                auto* const nodes = nodes_of(page);
+                for(auto base = size_type{0}; base < page->carved; base += detail::pyramid_word_bits) {
+                    auto word = words[base / detail::pyramid_word_bits];
+                    for(; word != 0; word &= word - 1)
+                        f(nodes[base + detail::pyramid_trailing_zeros(word)].item);
+                }
+            }
+        }
+        
+        
+        template<typename Function>
+        void for_each(Function&& f) const {
+            const_cast<concurrent_pyramid&>(*this).for_each([&f](T& item) { f(std::as_const(item)); });
+        }
+        
+        
+        // Nothing should be inserted or erased meanwhile
+        void clear() noexcept {
+            if constexpr(!detail::pyramid_trivially_destroyed<T, A>)
+                for_each([this](T& item) { allocator_traits::destroy(allocator_, &item); });
+            auto allocator = page_allocator{allocator_};
+            while(pages_ != nullptr) {
+                auto* page = pages_;
+                pages_ = page->next_page;
+                page_allocator_traits::deallocate(allocator, reinterpret_cast<page_block*>(page), 1);
+            }
+            for(auto& c: caches_) {
+                c.loaded = nullptr;
+                c.loaded_size = 0;
+                c.previous = nullptr;
+                c.size.store(0, std::memory_order_relaxed);
+            }
+            depot_ = nullptr;
+            capacity_.store(0, std::memory_order_relaxed);
+        }
+    
+    
+    private:
+        
+        cache& own_cache() noexcept {
+            return caches_[detail::pyramid_thread_index() % caches];
+        }
+        
+        
+        node_type* take_node(cache& c) {
+            auto const lock = std::lock_guard<detail::pyramid_spinlock>{c.lock};
+            if(c.loaded_size == 0) {
+                if(c.previous != nullptr) {
+                    c.loaded = c.previous;
+                    c.loaded_size = M;
+                    c.previous = nullptr;
+                } else {
+                    c.loaded_size = refill(c.loaded);
+                }
+            }
+            auto* node = c.loaded;
+            c.loaded = node->links.next_free;
+            --c.loaded_size;
+            c.size.store(c.size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return node;
+        }
+        
+        
+        void put_node(cache& c, node_type* node) noexcept {
+            auto const lock = std::lock_guard<detail::pyramid_spinlock>{c.lock};
+            if(c.loaded_size == M) {
+                if(c.previous != nullptr) {
+                    auto const depot_lock = std::lock_guard<std::mutex>{depot_mutex_};
+                    c.previous->links.next_magazine = depot_;
+                    depot_ = c.previous;
+                }
+                c.previous = c.loaded;
+                c.loaded = nullptr;
+                c.loaded_size = 0;
+            }
+            node->links.next_free = c.loaded;
+            c.loaded = node;
+            ++c.loaded_size;
+            c.size.store(c.size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+        
+        
+        // Full magazine from depot or up to M nodes carved from the last page,
+        // returns number of nodes in loaded chain
+        size_type refill(node_type*& loaded) {
+            auto const lock = std::lock_guard<std::mutex>{depot_mutex_};
+            if(depot_ != nullptr) {
+                loaded = depot_;
+                depot_ = depot_->links.next_magazine;
+                return M;
+            }
+            if(pages_ == nullptr || pages_->carved == page_capacity)
+                allocate_page();
+            auto const carving = std::min(M, page_capacity - pages_->carved);
+            auto* const first = nodes_of(pages_) + pages_->carved;
+            for(auto i = size_type{0}; i != carving; ++i)
+                first[i].links.next_free = i + 1 != carving ? first + i + 1 : nullptr;
+            pages_->carved += carving;
+            loaded = first;
+            return carving;
+        }
+        
+        
+        void allocate_page() {
+            auto allocator = page_allocator{allocator_};
+            auto* page = reinterpret_cast<page_type*>(page_allocator_traits::allocate(allocator, 1));
+            page->next_page = pages_;
+            page->carved = 0;
+            pages_ = page;
+            capacity_.fetch_add(page_capacity, std::memory_order_relaxed);
+        }
+        
+        
+        // Carved nodes are taken as occupied, then nodes of loaded and previous
+        // magazines of caches and of full magazines in depot are vacated
+        void mark_occupied() noexcept {
+            for(auto* page = pages_; page != nullptr; page = page->next_page) {
+                auto* const words = occupancy(page);
+                auto const full = page->carved / detail::pyramid_word_bits;
+                std::fill(words, words + full, ~size_type{0});
+                if(page->carved % detail::pyramid_word_bits != 0)
+                    words[full] = ~(~size_type{0} << page->carved % detail::pyramid_word_bits);
+            }
+            for(auto const& c: caches_) {
+                vacate(c.loaded, c.loaded_size);
+                if(c.previous != nullptr)
+                    vacate(c.previous, M);
+            }
+            for(auto* magazine = depot_; magazine != nullptr; magazine = magazine->links.next_magazine)
+                vacate(magazine, M);
+        }
+        
+        
+        static void vacate(node_type* node, size_type n) noexcept {
+            for(; n != 0; --n, node = node->links.next_free) {
+                auto const slot = slot_of(node);
+                occupancy(page_of(node))[slot / detail::pyramid_word_bits] &=
+                    ~(size_type{1} << slot % detail::pyramid_word_bits);
+            }
+        }
+        
+        
+        static page_type* page_of(node_type* node) noexcept {
+            return reinterpret_cast<page_type*>(reinterpret_cast<std::uintptr_t>(node) & ~std::uintptr_t(PageBytes - 1));
+        }
+        
+        
+        static word_type* occupancy(page_type* page) noexcept {
+            return reinterpret_cast<word_type*>(reinterpret_cast<unsigned char*>(page) + sizeof(page_type));
+        }
+        
+        
+        static node_type* nodes_of(page_type* page) noexcept {
+            return reinterpret_cast<node_type*>(reinterpret_cast<unsigned char*>(page) + nodes_offset(page_capacity));
+        }
+        
+        
+        static size_type slot_of(node_type* node) noexcept {
+            return size_type(node - nodes_of(page_of(node)));
+        }
+    }; // concurrent_pyramid
+
+
+#if __has_include(<memory_resource>)
+    namespace pmr {
+        
+        
+        template<typename T,
+                 detail::pyramid_size_type M = 64,
+                 detail::pyramid_size_type PageBytes = detail::pyramid_size_type{1} << 16>
+        using concurrent_pyramid = etceteras::concurrent_pyramid<T, M, PageBytes, std::pmr::polymorphic_allocator<T>>;
+    
+    
+    } // namespace pmr
+#endif
+
+
+} // namespace etceteras
@@ -0,0 +1,473 @@
+// This file is part of etceteras library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "concurrent_pyramid.hpp"
+#include "pyramid.hpp"
+
+
+namespace etceteras {
+    
+    
+    namespace detail {
+        
+        // Readers follow only next_node, the rest belongs to the writer. Unlinked node keeps
+        // its next_node, so reader standing on it goes on to the rest of items
+        template<typename T>
+        struct epoch_pyramid_node {
+            union storage {
+                storage() noexcept { }
+                ~storage() { }
+                char buffer[sizeof(T)];
+                T item;
+            } data;
+            std::atomic<epoch_pyramid_node*> next_node;
+            epoch_pyramid_node* previous_node;  // next retired or vacant node once unlinked
+            std::uint64_t retired;              // epoch of unlinking
+        }; // epoch_pyramid_node
+        
+        
+        // Epoch a reader started in, zero if slot is free
+        struct alignas(pyramid_cache_line) epoch_pyramid_slot {
+            std::atomic<std::uint64_t> epoch{0};
+        }; // epoch_pyramid_slot
+    
+    
+    } // namespace detail
+    
+    
+    // Pyramid of one writer thread and many reader threads scanning it meanwhile.
+    // Readers announce the epoch they started in, erased nodes are unlinked at once
+    // but neither destroyed nor reused until every reader that could see them leaves.
+    // Writer never waits for readers, erased nodes just pile up while readers stay
+    template<typename T,
+             detail::pyramid_size_type Readers = 64,
+             typename G = pyramid_growth::geometric<16>,
+             typename A = std::allocator<T>>
+    class epoch_pyramid {
+        
+        using node_type = detail::epoch_pyramid_node<T>;
+        using slot_type = detail::epoch_pyramid_slot;
+        using allocator_traits = std::allocator_traits<A>;
+        using node_allocator = typename allocator_traits::template rebind_alloc<node_type>;
+        using node_allocator_traits = std::allocator_traits<node_allocator>;
+        
+        static_assert(std::is_same_v<typename allocator_traits::value_type, T>,
+                      "Allocator should have the same value_type as epoch_pyramid");
+        static_assert(std::is_pointer_v<typename node_allocator_traits::pointer>,
+                      "Allocators with fancy pointers are not supported");
+        static_assert(Readers > 0, "There should be room for at least one reader");
+        
+        struct page {
+            node_type* nodes;
+            detail::pyramid_size_type capacity;
+        }; // page
+        
+        using page_allocator = typename allocator_traits::template rebind_alloc<page>;
+        
+        A allocator_;
+        std::vector<page, page_allocator> pages_;
+        detail::pyramid_size_type capacity_{0};
+        detail::pyramid_size_type carved_{0};       // nodes handed out from the last page
+        std::atomic<detail::pyramid_size_type> size_{0};
+        node_type head_;                            // its next_node is the first item
+        node_type* last_node_;
+        node_type* vacant_nodes_{nullptr};
+        node_type* retired_first_{nullptr};         // in order of unlinking
+        node_type* retired_last_{nullptr};
+        detail::pyramid_size_type retired_{0};
+        std::atomic<std::uint64_t> epoch_{1};
+        mutable slot_type slots_[Readers];
+    
+    public:
+        
+        using size_type = detail::pyramid_size_type;
+        using value_type = T;
+        using growth_policy = G;
+        using allocator_type = A;
+        
+        static size_type constexpr readers = Readers;
+        
+        // Erased nodes wait until there are this many of them before writer looks at readers
+        static size_type constexpr reclaim_batch = 64;
+        
+        
+        // Writer side, items are valid until erased
+        class iterator {
+        friend class epoch_pyramid;
+            node_type* node_;
+            
+            explicit iterator(node_type* node) noexcept: node_{node} { }
+        
+        public:
+            
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+            
+            bool operator == (iterator const& other) const noexcept {
+                return node_ == other.node_;
+            }
+            
+            bool operator != (iterator const& other) const noexcept {
+                return node_ != other.node_;
+            }
+            
+            T& operator * () const noexcept {
+                return node_->data.item;
+            }
+            
+            T* operator -> () const noexcept {
+                return &node_->data.item;
+            }
+            
+            iterator& operator ++ () noexcept {
+                node_ = node_->next_node.load(std::memory_order_relaxed);
+                return *this;
+            }
+            
+            iterator operator ++ (int) noexcept {
+                auto const last = *this;
+                ++*this;
+                return last;
+            }
+        }; // iterator
+        
+        
+        // Reader side, valid while reader that made it is alive
+        class const_iterator {
+        friend class epoch_pyramid;
+            node_type const* node_;
+            
+            explicit const_iterator(node_type const* node) noexcept: node_{node} { }
+        
+        public:
+            
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T const*;
+            using reference = T const&;
+            
+            bool operator == (const_iterator const& other) const noexcept {
+                return node_ == other.node_;
+            }
+            
+            bool operator != (const_iterator const& other) const noexcept {
+                return node_ != other.node_;
+            }
+            
+            T const& operator * () const noexcept {
+                return node_->data.item;
+            }
+            
+            T const* operator -> () const noexcept {
+                return &node_->data.item;
+            }
+            
+            const_iterator& operator ++ () noexcept {
+                node_ = node_->next_node.load(std::memory_order_acquire);
+                return *this;
+            }
+            
+            const_iterator operator ++ (int) noexcept {
+                auto const last = *this;
+                ++*this;
+                return last;
+            }
+        }; // const_iterator
+        
+        
+        // Holds reader slot from construction to destruction, items it reaches
+        // are neither destroyed nor reused meanwhile. Reader should not outlive
+        // the pyramid and should be kept short, it delays reuse of erased nodes
+        class reader {
+        friend class epoch_pyramid;
+            epoch_pyramid const* pyramid_;
+            slot_type* slot_;
+            
+            reader(epoch_pyramid const& pyramid, slot_type& slot) noexcept
+                : pyramid_{&pyramid}, slot_{&slot} { }
+        
+        public:
+            
+            reader(reader&& other) noexcept: pyramid_{other.pyramid_}, slot_{other.slot_} {
+                other.slot_ = nullptr;
+            }
+            
+            reader(reader const&) = delete;
+            reader& operator = (reader const&) = delete;
+            reader& operator = (reader&&) = delete;
+            
+            ~reader() {
+                if(slot_ != nullptr)
+                    slot_->epoch.store(0, std::memory_order_release);
+            }
+            
+            const_iterator begin() const noexcept {
+                return const_iterator{pyramid_->head_.next_node.load(std::memory_order_acquire)};
+            }
+            
+            const_iterator end() const noexcept {
+                return const_iterator{nullptr};
+            }
+            
+            template<typename Function>
+            void for_each(Function&& f) const {
+                for(auto const& item: *this)
+                    f(item);
+            }
+        }; // reader
+        
+        
+        epoch_pyramid() noexcept(noexcept(A())): epoch_pyramid(A()) { }
+        
+        
+        explicit epoch_pyramid(A const& allocator) noexcept
+            : allocator_{allocator}, pages_(page_allocator{allocator}), last_node_{&head_} {
+            head_.next_node.store(nullptr, std::memory_order_relaxed);
+        }
+        
+        
+        epoch_pyramid(epoch_pyramid const&) = delete;
+        epoch_pyramid& operator = (epoch_pyramid const&) = delete;
+        
+        
+        // There should be no readers left
+        ~epoch_pyramid() {
+            clear();
+            reclaim(true);
+            auto allocator = node_allocator{allocator_};
+            for(auto const& p: pages_)
+                node_allocator_traits::deallocate(allocator, p.nodes, p.capacity);
+        }
+        
+        
+        allocator_type get_allocator() const noexcept {
+            return allocator_;
+        }
+        
+        
+        // May be called by readers, then it is just a recent value
+        size_type size() const noexcept {
+            return size_.load(std::memory_order_relaxed);
+        }
+        
+        
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+        
+        
+        size_type capacity() const noexcept {
+            return capacity_;
+        }
+        
+        
+        // Erased items waiting for readers
+        size_type retired() const noexcept {
+            return retired_;
+        }
+        
+        
+        // Takes a free reader slot starting from the one of calling thread,
+        // waits if all of them are taken
+        reader read() const noexcept {
+            for(auto index = detail::pyramid_thread_index();; ++index) {
+                auto& slot = slots_[index % Readers];
+                auto expected = std::uint64_t{0};
+                auto epoch = epoch_.load();
+                if(slot.epoch.load(std::memory_order_relaxed) == 0 && slot.epoch.compare_exchange_strong(expected, epoch)) {
+                    // Either writer sees the slot or reader sees epoch writer moved to
+                    for(auto current = epoch_.load(); current != epoch; current = epoch_.load()) {
+                        epoch = current;
+                        slot.epoch.store(epoch);
+                    }
+                    return reader{*this, slot};
+                }
+                if(index % Readers == Readers - 1)
+                    std::this_thread::yield();
+            }
+        }
+        
+        
+        // Writer side iteration
+        iterator begin() noexcept {
+            return iterator{head_.next_node.load(std::memory_order_relaxed)};
+        }
+        
+        
+        iterator end() noexcept {
+            return iterator{nullptr};
+        }
+        
+        
+        iterator insert(T const& item) {
+            return emplace(item);
+        }
+        
+        
+        iterator insert(T&& item) {
+            return emplace(std::move(item));
+        }
+        
+        
+        // Item is constructed before its node is published to readers
+        template<typename... Args>
+        iterator emplace(Args&&... args) {
+            auto* node = vacant_node();
+            allocator_traits::construct(allocator_, &node->data.item, std::forward<Args>(args)...);
+            if(node == vacant_nodes_) {
+                vacant_nodes_ = node->previous_node;
+                node->next_node.store(nullptr, std::memory_order_relaxed);
+            } else {
+                ++carved_;
+                new(&node->next_node) std::atomic<node_type*>{nullptr};
+            }
+            node->previous_node = last_node_;
+            last_node_->next_node.store(node, std::memory_order_release);
+            last_node_ = node;
+            size_.store(size_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return iterator{node};
+        }
+        
+        
+        // Unlinks item at once, destroys it once no reader can reach it
+        iterator erase(iterator it) noexcept {
+            auto* node = it.node_;
+            auto* next = node->next_node.load(std::memory_order_relaxed);
+            node->previous_node->next_node.store(next, std::memory_order_release);
+            if(next != nullptr)
+                next->previous_node = node->previous_node;
+            else
+                last_node_ = node->previous_node;
+            retire(node);
+            size_.store(size_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            if(retired_ >= reclaim_batch)
+                reclaim();
+            return iterator{next};
+        }
+        
+        
+        // Unlinks all items, readers in the middle of them go on to the end
+        void clear() noexcept {
+            auto* node = head_.next_node.load(std::memory_order_relaxed);
+            head_.next_node.store(nullptr, std::memory_order_release);
+            last_node_ = &head_;
+            for(; node != nullptr; node = node->next_node.load(std::memory_order_relaxed))
+                retire(node);
+            size_.store(0, std::memory_order_relaxed);
+            reclaim();
+        }
+        
+        
+        // Destroys erased items no reader can reach and makes their nodes vacant,
+        // returns their number. Called by writer every reclaim_batch erased items
+        size_type reclaim() noexcept {
+            return reclaim(false);
+        }
+    
+    
+    private:
+        
+        void retire(node_type* node) noexcept {
+            node->retired = epoch_.load(std::memory_order_relaxed);
+            node->previous_node = nullptr;
+            if(retired_last_ == nullptr)
+                retired_first_ = node;
+            else
+                retired_last_->previous_node = node;
+            retired_last_ = node;
+            ++retired_;
+        }
+        
+        
+        // Moves to the next epoch, so new readers can not reach what is retired already,
+        // then frees nodes retired before the oldest epoch readers are in
+        size_type reclaim(bool unconditionally) noexcept {
+            if(retired_first_ == nullptr)
+                return 0;
+            auto oldest = epoch_.fetch_add(1) + 1;
+            if(!unconditionally)
+                for(auto& slot: slots_) {
+                    auto const epoch = slot.epoch.load();
+                    if(epoch != 0 && epoch < oldest)
+                        oldest = epoch;
+                }
+            auto reclaimed = size_type{0};
+            while(retired_first_ != nullptr && retired_first_->retired < oldest) {
+                auto* node = retired_first_;
+                retired_first_ = node->previous_node;
+                allocator_traits::destroy(allocator_, &node->data.item);
+                node->previous_node = vacant_nodes_;
+                vacant_nodes_ = node;
+                ++reclaimed;
+            }
+            if(retired_first_ == nullptr)
+                retired_last_ = nullptr;
+            retired_ -= reclaimed;
+            return reclaimed;
+        }
+        
+        
+        // Node to occupy next, reclaimed one or the next one carved from the last page
+        node_type* vacant_node() {
+            if(vacant_nodes_ == nullptr && retired_ != 0)
+                reclaim();
+            if(vacant_nodes_ != nullptr)
+                return vacant_nodes_;
+            if(pages_.empty() || carved_ == pages_.back().capacity)
+                allocate_page();
+            return pages_.back().nodes + carved_;
+        }
+        
+        
+        void allocate_page() {
+            auto const capacity = G::page_capacity(pyramid_growth::context{
+                capacity_,
+                pages_.empty() ? 0 : pages_.back().capacity,
+                sizeof(node_type),
+                0
+            });
+            if(capacity == 0)
+                throw std::bad_alloc{};
+            pages_.reserve(pages_.size() + 1);
+            auto allocator = node_allocator{allocator_};
+            pages_.push_back(page{node_allocator_traits::allocate(allocator, capacity), capacity});
+            capacity_ += capacity;
+            carved_ = 0;
+        }
+    }; // epoch_pyramid
+
+
+#if __has_include(<memory_resource>)
+    namespace pmr {
+        
+        
+        template<typename T,
+                 detail::pyramid_size_type Readers = 64,
+                 typename G = pyramid_growth::geometric<16>>
+        using epoch_pyramid = etceteras::epoch_pyramid<T, Readers, G, std::pmr::polymorphic_allocator<T>>;
+    
+    
+    } // namespace pmr
+#endif
+
+
+} // namespace etceteras
@@ -0,0 +1,215 @@
+// This file is part of etceteras library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "pyramid.hpp"
+
+
+namespace etceteras {
+
+
+    std::size_t constexpr huge_page_size = std::size_t{1} << 21;
+    int constexpr any_numa_node = -1;
+    
+    
+    enum class huge_page_mode {
+        none,           // regular pages
+        transparent,    // huge page aligned mapping with madvise(MADV_HUGEPAGE)
+        reserved        // MAP_HUGETLB from the reserved pool, transparent if the pool is exhausted
+    }; // huge_page_mode
+    
+    
+    namespace detail {
+    
+    
+        inline std::size_t huge_page_rounded(std::size_t size) noexcept {
+            return (size + huge_page_size - 1) & ~(huge_page_size - 1);
+        }
+        
+        
+#if defined(__linux__)
+        // Prefers the node but lets the kernel fall back to others when it is full,
+        // fails silently without NUMA support in the kernel
+        inline void prefer_numa_node(void* address, std::size_t size, int numa_node) noexcept {
+#if defined(SYS_mbind)
+            int constexpr mpol_preferred = 1;
+            unsigned long mask[16] = {};
+            auto constexpr mask_bits = sizeof(mask[0]) * 8;
+            if(numa_node < 0 || std::size_t(numa_node) >= sizeof(mask) * 8)
+                return;
+            mask[numa_node / mask_bits] = 1ul << (numa_node % mask_bits);
+            // The kernel expects one more than the number of bits in mask
+            ::syscall(SYS_mbind, address, size, mpol_preferred, mask, sizeof(mask) * 8 + 1, 0);
+#else
+            (void)address;
+            (void)size;
+            (void)numa_node;
+#endif
+        }
+        
+        
+        inline void populate_pages(void* address, std::size_t size) noexcept {
+#if defined(MADV_POPULATE_WRITE)
+            if(::madvise(address, size, MADV_POPULATE_WRITE) == 0)
+                return;
+#endif
+            auto* first = static_cast<char volatile*>(address);
+            for(auto* last = first + size; first < last; first += pyramid_prefault_stride)
+                *first = 0;
+        }
+        
+        
+        inline void* map_reserved_huge_pages(std::size_t size) noexcept {
+#if defined(MAP_HUGETLB)
+            auto* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            return mapped == MAP_FAILED ? nullptr : mapped;
+#else
+            (void)size;
+            return nullptr;
+#endif
+        }
+        
+        
+        // Maps with a huge page of slack and trims it to get an aligned region
+        inline void* map_aligned_pages(std::size_t size, huge_page_mode mode) noexcept {
+            auto const slack = mode == huge_page_mode::none ? 0 : huge_page_size;
+            auto* mapped = ::mmap(nullptr, size + slack, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(mapped == MAP_FAILED)
+                return nullptr;
+            if(slack == 0)
+                return mapped;
+            auto* first = static_cast<char*>(mapped);
+            auto const head = (huge_page_size - reinterpret_cast<std::uintptr_t>(first) % huge_page_size)
+                % huge_page_size;
+            if(head != 0)
+                ::munmap(first, head);
+            if(slack != head)
+                ::munmap(first + head + size, slack - head);
+#if defined(MADV_HUGEPAGE)
+            ::madvise(first + head, size, MADV_HUGEPAGE);
+#endif
+            return first + head;
+        }
+        
+        
+        inline void* map_huge_pages(std::size_t size, huge_page_mode mode, int numa_node, bool populate) noexcept {
+            size = huge_page_rounded(size);
+            void* mapped = nullptr;
+            if(mode == huge_page_mode::reserved)
+                mapped = map_reserved_huge_pages(size);
+            if(!mapped)
+                mapped = map_aligned_pages(size, mode);
+            if(!mapped)
+                return nullptr;
+            if(numa_node != any_numa_node)
+                prefer_numa_node(mapped, size, numa_node);
+            if(populate)
+                populate_pages(mapped, size);
+            return mapped;
+        }
+        
+        
+        inline void unmap_huge_pages(void* address, std::size_t size) noexcept {
+            ::munmap(address, huge_page_rounded(size));
+        }
+#else
+        // Aligned by huge_page_size like mapped memory, so alignment requests up to it hold
+        inline void* map_huge_pages(std::size_t size, huge_page_mode, int, bool) noexcept {
+            return ::operator new(huge_page_rounded(size), std::align_val_t{huge_page_size}, std::nothrow);
+        }
+        
+        
+        inline void unmap_huge_pages(void* address, std::size_t) noexcept {
+            ::operator delete(address, std::align_val_t{huge_page_size});
+        }
+#endif
+    
+    
+    } // namespace detail
+    
+    
+    // Maps memory in multiples of huge_page_size directly from the OS,
+    // optionally preferring a NUMA node and faulting pages in up front
+    template<typename T>
+    class huge_page_allocator {
+    template<typename U> friend class huge_page_allocator;
+    
+        huge_page_mode mode_;
+        int numa_node_;
+        bool populate_;
+        
+    public:
+    
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::true_type;
+        
+        
+        explicit huge_page_allocator(huge_page_mode mode = huge_page_mode::transparent,
+                                     int numa_node = any_numa_node,
+                                     bool populate = false) noexcept
+            : mode_{mode}, numa_node_{numa_node}, populate_{populate} { }
+            
+        
+        template<typename U>
+        huge_page_allocator(huge_page_allocator<U> const& other) noexcept
+            : mode_{other.mode_}, numa_node_{other.numa_node_}, populate_{other.populate_} { }
+            
+        
+        huge_page_mode mode() const noexcept { return mode_; }
+        int numa_node() const noexcept { return numa_node_; }
+        bool populates() const noexcept { return populate_; }
+        
+        
+        T* allocate(std::size_t n) {
+            if(n > (~std::size_t{0} - huge_page_size) / sizeof(T))
+                throw std::bad_alloc{};
+            auto* allocated = detail::map_huge_pages(n * sizeof(T), mode_, numa_node_, populate_);
+            if(!allocated)
+                throw std::bad_alloc{};
+            return static_cast<T*>(allocated);
+        }
+        
+        
+        void deallocate(T* p, std::size_t n) noexcept {
+            detail::unmap_huge_pages(p, n * sizeof(T));
+        }
+        
+        
+        template<typename U>
+        bool operator == (huge_page_allocator<U> const&) const noexcept {
+            return true;
+        }
+        
+        
+        template<typename U>
+        bool operator != (huge_page_allocator<U> const&) const noexcept {
+            return false;
+        }
+    }; // huge_page_allocator
+    
+    
+    // Pages of Growth rounded up to whole huge pages
+    template<typename T, typename G = pyramid_growth::geometric<16>>
+    using huge_page_pyramid = pyramid<T, 16, pyramid_growth::rounded<G, huge_page_size>, huge_page_allocator<T>>;
+
+
+} // namespace etceteras
@@ -0,0 +1,204 @@
+// This file is part of etceteras library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<execution>)
+#include <execution>
+#endif
+
+#include "pyramid.hpp"
+
+
+namespace etceteras {
+    
+    
+    // Nodes per chunk of parallel traversal unless told otherwise
+    detail::pyramid_size_type constexpr parallel_grain = 4096;
+    
+    
+    namespace detail {
+
+
+#if defined(__cpp_lib_execution)
+        template<typename E>
+        bool constexpr is_execution_policy = std::is_execution_policy_v<std::decay_t<E>>;
+#else
+        template<typename E>
+        bool constexpr is_execution_policy = false;
+#endif
+        
+        
+        // Chunks are taken one by one by whoever runs a task, the caller included.
+        // Tasks share traversal, so those run after all chunks are visited find nothing to do
+        template<typename Chunk, typename Function>
+        class parallel_traversal {
+            std::vector<Chunk> chunks_;
+            Function& f_;
+            std::atomic<pyramid_size_type> next_{0};
+            std::atomic<bool> failed_{false};
+            std::mutex mutex_;
+            std::condition_variable finished_;
+            pyramid_size_type visited_{0};
+            std::exception_ptr failure_;
+        
+        public:
+            
+            parallel_traversal(std::vector<Chunk> chunks, Function& f) noexcept
+                : chunks_{std::move(chunks)}, f_{f} { }
+            
+            
+            pyramid_size_type chunks() const noexcept {
+                return chunks_.size();
+            }
+            
+            
+            // Chunks after failure are skipped but still counted as visited
+            void visit() noexcept {
+                for(auto index = next_++; index < chunks_.size(); index = next_++) {
+                    auto failure = std::exception_ptr{};
+                    if(!failed_.load(std::memory_order_relaxed)) {
+                        try {
+                            chunks_[index].for_each(f_);
+                        } catch(...) {
+                            failure = std::current_exception();
+                            failed_.store(true, std::memory_order_relaxed);
+                        }
+                    }
+                    auto const lock = std::lock_guard<std::mutex>{mutex_};
+                    if(failure && !failure_)
+                        failure_ = failure;
+                    if(++visited_ == chunks_.size())
+                        finished_.notify_all();
+                }
+            }
+            
+            
+            void wait() {
+                auto lock = std::unique_lock<std::mutex>{mutex_};
+                finished_.wait(lock, [this] { return visited_ == chunks_.size(); });
+                if(failure_)
+                    std::rethrow_exception(failure_);
+            }
+        }; // parallel_traversal
+        
+        
+        template<typename P>
+        auto parallel_chunks(P& items, pyramid_size_type grain) {
+            auto chunks = std::vector<typename P::chunk>{};
+            chunks.reserve(items.capacity() / std::max(grain, pyramid_size_type{1}) + 1);
+            items.for_each_chunk(grain, [&chunks](typename P::chunk chunk) { chunks.push_back(chunk); });
+            return chunks;
+        }
+        
+        
+        // Executor is called with tasks, each task is a copyable callable without arguments
+        template<typename P, typename Function, typename Executor>
+        void parallel_for_each(P& items, Function& f, Executor&& executor,
+                               pyramid_size_type grain, pyramid_size_type tasks) {
+            if constexpr(is_execution_policy<Executor>) {
+#if defined(__cpp_lib_execution)
+                auto const chunks = parallel_chunks(items, grain);
+                std::for_each(std::forward<Executor>(executor), chunks.begin(), chunks.end(),
+                              [&f](typename P::chunk const& chunk) { chunk.for_each(f); });
+#endif
+            } else {
+                auto traversal = std::make_shared<parallel_traversal<typename P::chunk, Function>>(
+                    parallel_chunks(items, grain), f);
+                tasks = std::min(traversal->chunks(), tasks);
+                for(auto i = pyramid_size_type{1}; i < tasks; ++i) {
+                    try {
+                        executor([traversal] { traversal->visit(); });
+                    } catch(...) {
+                        // Executor is out of room, the rest is visited by the caller
+                        break;
+                    }
+                }
+                traversal->visit();
+                traversal->wait();
+            }
+        }
+        
+        
+        // Runs each task on a thread of its own, joined by the destructor
+        class parallel_threads {
+            std::vector<std::thread> threads_;
+        
+        public:
+            
+            parallel_threads() = default;
+            parallel_threads(parallel_threads const&) = delete;
+            parallel_threads& operator = (parallel_threads const&) = delete;
+            
+            ~parallel_threads() {
+                for(auto& thread: threads_)
+                    thread.join();
+            }
+            
+            template<typename Task>
+            void operator () (Task task) {
+                threads_.emplace_back(std::move(task));
+            }
+        }; // parallel_threads
+    
+    
+    } // namespace detail
+    
+    
+    // Visits items of pages cut into chunks of about grain nodes on up to tasks tasks including
+    // the calling thread, returns when all of them are visited. Executor is either execution
+    // policy or callable taking tasks, e.g. [&pool](auto task) { pool.post(task); }.
+    // f is called concurrently and should neither insert nor erase items, the first
+    // exception thrown by f is rethrown and stops visiting of chunks not yet taken
+    template<typename T, detail::pyramid_size_type F, typename G, typename A, typename L,
+             typename Function, typename Executor>
+    void parallel_for_each(pyramid<T, F, G, A, L>& items, Function f, Executor&& executor,
+                           detail::pyramid_size_type grain = parallel_grain,
+                           detail::pyramid_size_type tasks = std::thread::hardware_concurrency()) {
+        detail::parallel_for_each(items, f, std::forward<Executor>(executor), grain, tasks);
+    }
+    
+    
+    template<typename T, detail::pyramid_size_type F, typename G, typename A, typename L,
+             typename Function, typename Executor>
+    void parallel_for_each(pyramid<T, F, G, A, L> const& items, Function f, Executor&& executor,
+                           detail::pyramid_size_type grain = parallel_grain,
+                           detail::pyramid_size_type tasks = std::thread::hardware_concurrency()) {
+        auto visit = [&f](T& item) { f(std::as_const(item)); };
+        detail::parallel_for_each(const_cast<pyramid<T, F, G, A, L>&>(items), visit,
+                                  std::forward<Executor>(executor), grain, tasks);
+    }
+    
+    
+    // Runs on threads started for the traversal, one per hardware thread
+    template<typename T, detail::pyramid_size_type F, typename G, typename A, typename L, typename Function>
+    void parallel_for_each(pyramid<T, F, G, A, L>& items, Function f) {
+        auto threads = detail::parallel_threads{};
+        detail::parallel_for_each(items, f, threads, parallel_grain, std::thread::hardware_concurrency());
+    }
+    
+    
+    template<typename T, detail::pyramid_size_type F, typename G, typename A, typename L, typename Function>
+    void parallel_for_each(pyramid<T, F, G, A, L> const& items, Function f) {
+        auto threads = detail::parallel_threads{};
+        auto visit = [&f](T& item) { f(std::as_const(item)); };
+        detail::parallel_for_each(const_cast<pyramid<T, F, G, A, L>&>(items), visit, threads,
+                                  parallel_grain, std::thread::hardware_concurrency());
+    }
+
+
+} // namespace etceteras
@@ -5,67 +5,1033 @@
 #pragma once
 
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 
 namespace etceteras {
     
     
+    namespace pyramid_layout {
+        
+        
+        // Item and its links lie together in a node
+        struct interleaved { };
+        
+        
+        // Pages keep items in a dense array and their links in a parallel one,
+        // so scans of items do not drag links into cache
+        struct split { };
+        
+        
+        // Interleaved nodes linked by 32 bit (page index, slot) pairs instead of pointers,
+        // pyramid holds at most 4094 pages of at most 2^20 nodes each. max_size() is the
+        // capacity of 4094 pages as growth policy makes them, e.g. 65504 with fixed<16>.
+        // Pages cut short by reserve leave less room
+        struct compact { };
+        
+        
+        // Compact nodes with 32 bit generation each, so that pyramid_handle
+        // referring to erased item is told apart from the one reusing its node
+        struct generational { };
+        
+        
+        // Interleaved nodes with one more pointer, so that other threads
+        // can hand erased items back to the owner by remote_erase
+        struct shared { };
+    
+    
+    } // namespace pyramid_layout
+    
+    
     namespace detail {
         
         template<typename T>
         struct pyramid_node {
-            union {
+            union storage {
+                storage() noexcept { }
+                ~storage() { }
                 char buffer[sizeof(T)];
                 T item;
             } data;
             pyramid_node* previous_node;
             pyramid_node* next_node;
         }; // pyramid_node
-       
         
-        using pyramid_size_type = std::size_t;
+        
+        // Node of shared layout, next_returned links nodes erased by other threads
+        template<typename T>
+        struct pyramid_shared_node {
+            union storage {
+                storage() noexcept { }
+                ~storage() { }
+                char buffer[sizeof(T)];
+                T item;
+            } data;
+            pyramid_shared_node* previous_node;
+            pyramid_shared_node* next_node;
+            pyramid_shared_node* next_returned;
+        }; // pyramid_shared_node
+        
+        
+        // Node of split layout, item lies in array of the page at the same slot
+        template<typename T>
+        struct pyramid_link {
+            pyramid_link* previous_node;
+            pyramid_link* next_node;
+        }; // pyramid_link
+        
+        
+        // Node of compact layout, links are (page index, slot) pairs
+        template<typename T>
+        struct pyramid_compact_node {
+            union storage {
+                storage() noexcept { }
+                ~storage() { }
+                char buffer[sizeof(T)];
+                T item;
+            } data;
+            std::uint32_t previous_node;
+            std::uint32_t next_node;
+        }; // pyramid_compact_node
         
         
+        // Node of generational layout, generation is zero while node is vacant
         template<typename T>
+        struct pyramid_generational_node {
+            union storage {
+                storage() noexcept { }
+                ~storage() { }
+                char buffer[sizeof(T)];
+                T item;
+            } data;
+            std::uint32_t previous_node;
+            std::uint32_t next_node;
+            std::uint32_t generation;
+        }; // pyramid_generational_node
+        
+        
+        // Pointer linked nodes need nothing to find each other
+        struct pyramid_no_table { };
+        
+        
+        template<typename Node>
+        struct pyramid_page_table {
+            Node** nodes;   // nodes of pages by their indices
+        }; // pyramid_page_table
+        
+        
+        using pyramid_size_type = std::size_t;
+        
+        
+        // Granularity of memory touched by pyramid::reserve to prefault pages
+        pyramid_size_type constexpr pyramid_prefault_stride = 4096;
+        
+        
+        // Occupancy bitmaps are made of words of pyramid_size_type
+        pyramid_size_type constexpr pyramid_word_bits = std::numeric_limits<pyramid_size_type>::digits;
+        
+        
+        constexpr pyramid_size_type pyramid_words(pyramid_size_type nodes) noexcept {
+            return (nodes + pyramid_word_bits - 1) / pyramid_word_bits;
+        }
+        
+        
+        inline unsigned pyramid_trailing_zeros(pyramid_size_type word) noexcept {
+#if defined(_MSC_VER) && defined(_WIN64)
+            unsigned long index;
+            _BitScanForward64(&index, word);
+            return index;
+#elif defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, word);
+            return index;
+#else
+            return unsigned(__builtin_ctzll(word));
+#endif
+        }
+        
+        
+        // Granularity of prefetching
+        pyramid_size_type constexpr pyramid_cache_line = 64;
+        
+        
+        // Hints to fetch cache lines of size bytes from address, does nothing if unsupported
+        inline void pyramid_prefetch(void const* address, pyramid_size_type size) noexcept {
+            auto const first = reinterpret_cast<std::uintptr_t>(address) & ~(pyramid_cache_line - 1);
+            auto const last = reinterpret_cast<std::uintptr_t>(address) + size;
+            for(auto line = first; line < last; line += pyramid_cache_line) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+                _mm_prefetch(reinterpret_cast<char const*>(line), _MM_HINT_T0);
+#elif defined(_MSC_VER)
+                (void)line;
+#else
+                __builtin_prefetch(reinterpret_cast<void const*>(line));
+#endif
+            }
+        }
+        
+        
+        // Index of the first bit from position which is set in words or limit if there are none,
+        // bits are inverted for vacant nodes
+        template<bool Occupied>
+        pyramid_size_type pyramid_next_bit(pyramid_size_type const* words,
+                                           pyramid_size_type from,
+                                           pyramid_size_type limit) noexcept {
+            if(from >= limit)
+                return limit;
+            auto index = from / pyramid_word_bits;
+            auto word = (Occupied ? words[index] : ~words[index]) & (~pyramid_size_type{0} << from % pyramid_word_bits);
+            while(word == 0) {
+                if(++index * pyramid_word_bits >= limit)
+                    return limit;
+                word = Occupied ? words[index] : ~words[index];
+            }
+            return std::min(index * pyramid_word_bits + pyramid_trailing_zeros(word), limit);
+        }
+        
+        
+        // Nodes are followed by occupancy bitmap with a bit set for each occupied node.
+        // Ring of pages is linked both ways, so any page is unlinked in constant time
+        template<typename T, typename Node = pyramid_node<T>>
         struct pyramid_page {
             pyramid_page* next_page;
+            pyramid_page* previous_page;
             pyramid_size_type capacity;
-            pyramid_node<T> nodes[1];
+            pyramid_size_type carved;   // nodes handed out at least once
+            pyramid_size_type size;     // occupied nodes
+            pyramid_size_type index;    // in page table of compact layout
+            Node nodes[1];
+            
+            pyramid_size_type* occupancy() noexcept {
+                auto const address = reinterpret_cast<std::uintptr_t>(nodes + capacity);
+                auto const alignment = alignof(pyramid_size_type);
+                return reinterpret_cast<pyramid_size_type*>((address + alignment - 1) / alignment * alignment);
+            }
+            
+            void occupy(pyramid_size_type slot) noexcept {
+                occupancy()[slot / pyramid_word_bits] |= pyramid_size_type{1} << slot % pyramid_word_bits;
+            }
+            
+            void vacate(pyramid_size_type slot) noexcept {
+                occupancy()[slot / pyramid_word_bits] &= ~(pyramid_size_type{1} << slot % pyramid_word_bits);
+            }
+            
+            // Sentinel closes the ring of pages and has no nodes of its own
+            void make_sentinel() noexcept {
+                next_page = this;
+                previous_page = this;
+                capacity = 0;
+                carved = 0;
+                size = 0;
+            }
+            
+            // Sentinel links page at the end of the ring, its previous page is the last one
+            void append(pyramid_page* page) noexcept {
+                page->next_page = this;
+                page->previous_page = previous_page;
+                previous_page->next_page = page;
+                previous_page = page;
+            }
+            
+            void unlink() noexcept {
+                previous_page->next_page = next_page;
+                next_page->previous_page = previous_page;
+            }
+            
+            // Bytes up to the end of occupancy bitmap, nodes start no later than sizeof(Node) before page end
+            static pyramid_size_type bitmap_end(pyramid_size_type capacity) noexcept {
+                auto const alignment = alignof(pyramid_size_type);
+                auto const nodes_end = sizeof(pyramid_page) + (capacity - 1) * sizeof(Node);
+                return (nodes_end + alignment - 1) / alignment * alignment
+                    + pyramid_words(capacity) * sizeof(pyramid_size_type);
+            }
         }; // pyramid_page
         
         
+        // Pages sorted by address to find the page of a node or an item. It is kept on
+        // std::allocator, allocators meant for pages such as huge_page_allocator would
+        // spend a whole region on it. Sorted pages stay in place when directory is moved,
+        // so split layout iterators keep finding pages of their nodes
+        template<typename Page>
+        class pyramid_page_directory {
+            std::unique_ptr<std::vector<Page*>> pages_;
+        
+        public:
+            
+            using const_iterator = Page* const*;
+            
+            const_iterator begin() const noexcept {
+                return pages_ ? pages_->data() : nullptr;
+            }
+            
+            const_iterator end() const noexcept {
+                return pages_ ? pages_->data() + pages_->size() : nullptr;
+            }
+            
+            Page* operator [] (pyramid_size_type index) const noexcept {
+                return (*pages_)[index];
+            }
+            
+            std::vector<Page*> const* pages() const noexcept {
+                return pages_.get();
+            }
+            
+            // Nodes lie past page header, so address is compared with pages themselves
+            // and no page header is touched
+            static Page* page_of(std::vector<Page*> const& pages, void const* address) noexcept {
+                auto const it = std::upper_bound(pages.begin(), pages.end(), address, std::less<void const*>{});
+                return *(it - 1);
+            }
+            
+            Page* page_of(void const* address) const noexcept {
+                return page_of(*pages_, address);
+            }
+            
+            void insert(Page* page) {
+                if(!pages_)
+                    pages_ = std::make_unique<std::vector<Page*>>();
+                pages_->insert(std::upper_bound(pages_->begin(), pages_->end(), page, std::less<void const*>{}), page);
+            }
+            
+            void erase(Page* page) noexcept {
+                pages_->erase(std::lower_bound(pages_->begin(), pages_->end(), page, std::less<void const*>{}));
+            }
+            
+            void clear() noexcept {
+                if(pages_)
+                    pages_->clear();
+            }
+            
+            // Frees memory of directory as well
+            void release() noexcept {
+                pages_.reset();
+            }
+        }; // pyramid_page_directory
+        
+        
+        // Split layout finds item of a link by the page holding it
+        template<typename Page>
+        struct pyramid_split_table {
+            std::vector<Page*> const* pages{nullptr};
+        }; // pyramid_split_table
+        
+        
+        template<typename A, typename T, typename = void>
+        struct has_destroy: std::false_type { };
+        
+        
+        template<typename A, typename T>
+        struct has_destroy<A, T, std::void_t<decltype(std::declval<A&>().destroy(std::declval<T*>()))>>
+            : std::true_type { };
+        
+        
+        template<typename A, typename T, typename = void>
+        struct has_construct: std::false_type { };
+        
+        
+        template<typename A, typename T>
+        struct has_construct<A, T, std::void_t<decltype(std::declval<A&>().construct(std::declval<T*>(),
+                                                                                      std::declval<T const&>()))>>
+            : std::true_type { };
+        
+        
+        template<typename T, typename A>
+        bool constexpr is_standard_allocator = std::is_same_v<A, std::allocator<T>>
+#if __has_include(<memory_resource>)
+            || std::is_same_v<A, std::pmr::polymorphic_allocator<T>>
+#endif
+            ;
+        
+        
+        // Destruction of items can be skipped when it does nothing
+        template<typename T, typename A>
+        bool constexpr pyramid_trivially_destroyed = std::is_trivially_destructible_v<T>
+            && (!has_destroy<A, T>::value || is_standard_allocator<T, A>);
+        
+        
+        // Items can be copied as bytes when allocator does not intervene
+        template<typename T, typename A>
+        bool constexpr pyramid_trivially_copied = std::is_trivially_copyable_v<T>
+            && (!has_construct<A, T>::value || is_standard_allocator<T, A>);
+        
+        
+        // Unit of page allocation, keeps alignment of pages for any allocator
+        template<pyramid_size_type Alignment>
+        struct alignas(Alignment) pyramid_page_block {
+            unsigned char bytes[Alignment];
+        }; // pyramid_page_block
+        
+        
+        template<typename T, typename Layout>
+        struct pyramid_layout_traits;
+        
+        
+        // Besides placement of items layouts tell how nodes are addressed: handle
+        // is what links hold, table is what it takes to turn handle into node
+        template<typename T, typename Node>
+        struct pyramid_pointer_layout_traits {
+            using node = Node;
+            using page = pyramid_page<T, node>;
+            using handle = node*;
+            using table = pyramid_no_table;
+            using sentinel_table = pyramid_no_table;
+            
+            static bool constexpr indexed = false;
+            static bool constexpr generational = false;
+            static pyramid_size_type constexpr alignment = alignof(page);
+            static pyramid_size_type constexpr node_size = sizeof(node);
+            static pyramid_size_type constexpr page_overhead = sizeof(page) - sizeof(node);
+            static pyramid_size_type constexpr stride = sizeof(node);
+            static pyramid_size_type constexpr max_page_capacity = ~pyramid_size_type{0};
+            static pyramid_size_type constexpr max_size = ~pyramid_size_type{0} / sizeof(node);
+            
+            static node* at(table, handle h) noexcept { return h; }
+            static handle handle_of(page* p, pyramid_size_type slot) noexcept { return p->nodes + slot; }
+            static pyramid_size_type slot_of(page const* p, handle h) noexcept { return pyramid_size_type(h - p->nodes); }
+            static T* item(table, node* n) noexcept { return &n->data.item; }
+            static T* item(page* p, pyramid_size_type slot) noexcept { return &p->nodes[slot].data.item; }
+            
+            // Item is the first member of node
+            static handle handle_of(T* item) noexcept {
+                return reinterpret_cast<node*>(item);
+            }
+            
+            static pyramid_size_type page_bytes(pyramid_size_type capacity) noexcept {
+                return page::bitmap_end(capacity);
+            }
+            
+            // Copies nodes as bytes, links are to be fixed up
+            static void copy(page* to, pyramid_size_type to_slot,
+                             page const* from, pyramid_size_type from_slot,
+                             pyramid_size_type n) noexcept {
+                std::memcpy(static_cast<void*>(to->nodes + to_slot),
+                            static_cast<void const*>(from->nodes + from_slot),
+                            n * sizeof(node));
+            }
+        }; // pyramid_pointer_layout_traits
+        
+        
+        template<typename T>
+        struct pyramid_layout_traits<T, pyramid_layout::interleaved>
+            : pyramid_pointer_layout_traits<T, pyramid_node<T>> {
+            static bool constexpr returnable = false;
+        }; // pyramid_layout_traits
+        
+        
+        template<typename T>
+        struct pyramid_layout_traits<T, pyramid_layout::shared>
+            : pyramid_pointer_layout_traits<T, pyramid_shared_node<T>> {
+            static bool constexpr returnable = true;
+        }; // pyramid_layout_traits
+        
+        
+        // Page index takes upper bits of handle and slot in the page lower ones,
+        // indices 0 and 1 stand for pages of list sentinels
+        template<typename T, typename Node>
+        struct pyramid_indexed_layout_traits {
+            using node = Node;
+            using page = pyramid_page<T, node>;
+            using handle = std::uint32_t;
+            using table = pyramid_page_table<node>;
+            using sentinel_table = node*[2];
+            
+            static bool constexpr indexed = true;
+            static bool constexpr returnable = false;
+            static unsigned constexpr slot_bits = 20;
+            static pyramid_size_type constexpr table_size = pyramid_size_type{1} << (32 - slot_bits);
+            static handle constexpr free_list = 0;
+            static handle constexpr occupied_list = handle{1} << slot_bits;
+            static pyramid_size_type constexpr alignment = alignof(page);
+            static pyramid_size_type constexpr node_size = sizeof(node);
+            static pyramid_size_type constexpr page_overhead = sizeof(page) - sizeof(node) + alignof(pyramid_size_type) - 1;
+            static pyramid_size_type constexpr stride = sizeof(node);
+            static pyramid_size_type constexpr max_page_capacity = pyramid_size_type{1} << slot_bits;
+            static pyramid_size_type constexpr max_size = (table_size - 2) * max_page_capacity;
+            
+            static node* at(table t, handle h) noexcept {
+                return t.nodes[h >> slot_bits] + (h & (max_page_capacity - 1));
+            }
+            
+            static handle handle_of(page* p, pyramid_size_type slot) noexcept {
+                return handle(p->index << slot_bits | slot);
+            }
+            
+            static pyramid_size_type slot_of(page const*, handle h) noexcept {
+                return h & (max_page_capacity - 1);
+            }
+            
+            static T* item(table, node* n) noexcept { return &n->data.item; }
+            static T* item(page* p, pyramid_size_type slot) noexcept { return &p->nodes[slot].data.item; }
+            
+            static pyramid_size_type slot_of(page const* p, T const* item) noexcept {
+                auto const offset = reinterpret_cast<unsigned char const*>(item)
+                    - reinterpret_cast<unsigned char const*>(p->nodes);
+                return pyramid_size_type(offset) / sizeof(node);
+            }
+            
+            static pyramid_size_type page_bytes(pyramid_size_type capacity) noexcept {
+                return page::bitmap_end(capacity);
+            }
+            
+            static void copy(page* to, pyramid_size_type to_slot,
+                             page const* from, pyramid_size_type from_slot,
+                             pyramid_size_type n) noexcept {
+                std::memcpy(static_cast<void*>(to->nodes + to_slot),
+                            static_cast<void const*>(from->nodes + from_slot),
+                            n * sizeof(node));
+            }
+        }; // pyramid_indexed_layout_traits
+        
+        
+        template<typename T>
+        struct pyramid_layout_traits<T, pyramid_layout::compact>
+            : pyramid_indexed_layout_traits<T, pyramid_compact_node<T>> {
+            static bool constexpr generational = false;
+        }; // pyramid_layout_traits
+        
+        
+        template<typename T>
+        struct pyramid_layout_traits<T, pyramid_layout::generational>
+            : pyramid_indexed_layout_traits<T, pyramid_generational_node<T>> {
+            static bool constexpr generational = true;
+        }; // pyramid_layout_traits
+        
+        
+        // Page is followed by links, occupancy bitmap and items
+        template<typename T>
+        struct pyramid_layout_traits<T, pyramid_layout::split> {
+            using node = pyramid_link<T>;
+            using page = pyramid_page<T, node>;
+            using handle = node*;
+            using table = pyramid_split_table<page>;
+            using sentinel_table = pyramid_no_table;
+            
+            static bool constexpr indexed = false;
+            static bool constexpr generational = false;
+            static bool constexpr returnable = false;
+            static pyramid_size_type constexpr alignment = alignof(page) > alignof(T) ? alignof(page) : alignof(T);
+            static pyramid_size_type constexpr node_size = sizeof(node) + sizeof(T);
+            static pyramid_size_type constexpr page_overhead = sizeof(page) - sizeof(node) + alignof(T) - 1;
+            static pyramid_size_type constexpr stride = sizeof(T);
+            static pyramid_size_type constexpr max_page_capacity = ~pyramid_size_type{0};
+            static pyramid_size_type constexpr max_size = ~pyramid_size_type{0} / node_size;
+            
+            static node* at(table, handle h) noexcept { return h; }
+            static handle handle_of(page* p, pyramid_size_type slot) noexcept { return p->nodes + slot; }
+            static pyramid_size_type slot_of(page const* p, handle h) noexcept { return pyramid_size_type(h - p->nodes); }
+            
+            // Takes log of page count to find the page of link
+            static T* item(table t, node* n) noexcept {
+                auto* const p = pyramid_page_directory<page>::page_of(*t.pages, n);
+                return item(p, slot_of(p, n));
+            }
+            
+            static T* item(page* p, pyramid_size_type slot) noexcept {
+                return items(p) + slot;
+            }
+            
+            static pyramid_size_type slot_of(page const* p, T const* item) noexcept {
+                return pyramid_size_type(item - items(const_cast<page*>(p)));
+            }
+            
+            static pyramid_size_type page_bytes(pyramid_size_type capacity) noexcept {
+                return items_offset(capacity) + capacity * sizeof(T);
+            }
+            
+            static void copy(page* to, pyramid_size_type to_slot,
+                             page const* from, pyramid_size_type from_slot,
+                             pyramid_size_type n) noexcept {
+                std::memcpy(static_cast<void*>(items(to) + to_slot),
+                            static_cast<void const*>(items(const_cast<page*>(from)) + from_slot),
+                            n * sizeof(T));
+            }
+        
+        private:
+            
+            static pyramid_size_type items_offset(pyramid_size_type capacity) noexcept {
+                return (page::bitmap_end(capacity) + alignof(T) - 1) / alignof(T) * alignof(T);
+            }
+            
+            static T* items(page* p) noexcept {
+                return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(p) + items_offset(p->capacity));
+            }
+        }; // pyramid_layout_traits
+    
+    
     } // namespace detail
     
     
-    template<typename T, detail::pyramid_size_type F = 16>
-    class pyramid {
+    // Items lying in memory at the same distance of stride bytes one after another
+    template<typename T>
+    class strided_span {
+        T* data_;
+        std::size_t size_;
+        std::size_t stride_;
+    
+    public:
         
-        detail::pyramid_size_type capacity_;
-        detail::pyramid_size_type size_;
-        detail::pyramid_page<T> pages_;
-        detail::pyramid_size_type next_page_estimate_;
-        detail::pyramid_node<T> free_nodes_;
-        detail::pyramid_node<T> occupied_nodes_;
+        using size_type = std::size_t;
+        using element_type = T;
         
-    public:
+        constexpr strided_span(T* data, size_type size, size_type stride) noexcept
+            : data_{data}, size_{size}, stride_{stride} { }
+        
+        constexpr T* data() const noexcept { return data_; }
+        constexpr size_type size() const noexcept { return size_; }
+        constexpr bool empty() const noexcept { return size_ == 0; }
+        constexpr size_type stride() const noexcept { return stride_; }
+        
+        // Dense spans can be processed as plain arrays
+        constexpr bool contiguous() const noexcept { return stride_ == sizeof(T); }
+        
+        T& operator [] (size_type i) const noexcept {
+            using byte = std::conditional_t<std::is_const_v<T>, unsigned char const, unsigned char>;
+            return *std::launder(reinterpret_cast<T*>(reinterpret_cast<byte*>(data_) + i * stride_));
+        }
+    }; // strided_span
     
+    
+    namespace pyramid_growth {
+        
+        
+        using size_type = detail::pyramid_size_type;
+        
+        
+        // What a growth policy gets to know when pyramid runs out of free nodes
+        struct context {
+            size_type capacity;         // nodes in all pages
+            size_type last_page;        // nodes in the most recent page, 0 if there are no pages
+            size_type node_size;        // bytes per node
+            size_type page_overhead;    // bytes per page besides its nodes
+        }; // context
+        
+        
+        size_type constexpr unlimited = ~size_type{0};
+        
+        
+        // Bytes taken by a page of n nodes including its occupancy bitmap
+        constexpr size_type page_bytes(context const& c, size_type n) noexcept {
+            return c.page_overhead + n * c.node_size + detail::pyramid_words(n) * sizeof(size_type);
+        }
+        
+        
+        // Most nodes fitting into a page of given bytes along with their occupancy bitmap
+        constexpr size_type page_nodes(context const& c, size_type bytes) noexcept {
+            if(bytes <= c.page_overhead)
+                return 0;
+            auto const available = bytes - c.page_overhead;
+            auto const word_group = detail::pyramid_word_bits * c.node_size + sizeof(size_type);
+            auto const rest = available % word_group;
+            auto const tail = rest > sizeof(size_type) ? (rest - sizeof(size_type)) / c.node_size : 0;
+            return available / word_group * detail::pyramid_word_bits + tail;
+        }
+        
+        
+        // Each new page multiplies total capacity by Factor, pages are capped by MaxPage nodes
+        template<size_type Factor, size_type MaxPage = unlimited>
+        struct geometric {
+            static_assert(Factor > 1, "Factor should be greater than one");
+            static_assert(MaxPage > 0, "MaxPage should be positive");
+            
+            static size_type constexpr page_capacity(context const& c) noexcept {
+                if(c.capacity == 0)
+                    return Factor < MaxPage ? Factor : MaxPage;
+                if(c.capacity > MaxPage / (Factor - 1))
+                    return MaxPage;
+                return c.capacity * (Factor - 1);
+            }
+        }; // geometric
+        
+        
+        // Each new page is Increment nodes larger than the previous one
+        template<size_type Initial, size_type Increment = Initial>
+        struct linear {
+            static_assert(Initial > 0, "Initial should be positive");
+            
+            static size_type constexpr page_capacity(context const& c) noexcept {
+                if(c.last_page == 0)
+                    return Initial;
+                if(c.last_page > unlimited - Increment)
+                    return unlimited;
+                return c.last_page + Increment;
+            }
+        }; // linear
+        
+        
+        // All pages have the same number of nodes
+        template<size_type Nodes>
+        struct fixed {
+            static_assert(Nodes > 0, "Nodes should be positive");
+            
+            static size_type constexpr page_capacity(context const&) noexcept {
+                return Nodes;
+            }
+        }; // fixed
+        
+        
+        // Pages take at most Bytes including page overhead, but have at least one node
+        template<size_type Bytes>
+        struct budgeted {
+            static size_type constexpr page_capacity(context const& c) noexcept {
+                auto const nodes = page_nodes(c, Bytes);
+                return nodes != 0 ? nodes : 1;
+            }
+        }; // budgeted
+        
+        
+        // Rounds pages of Growth up to take a multiple of Bytes including page overhead
+        template<typename Growth, size_type Bytes>
+        struct rounded {
+            static_assert(Bytes > 0, "Bytes should be positive");
+            
+            static size_type constexpr page_capacity(context const& c) noexcept {
+                auto const capacity = Growth::page_capacity(c);
+                if(capacity > (unlimited - c.page_overhead - (Bytes - 1)) / (c.node_size + 1))
+                    return capacity;
+                auto const bytes = page_bytes(c, capacity);
+                auto const rounded_bytes = (bytes + Bytes - 1) / Bytes * Bytes;
+                return page_nodes(c, rounded_bytes);
+            }
+        }; // rounded
+    
+    
+    } // namespace pyramid_growth
+    
+    
+    // Which of erased nodes insert reuses first
+    enum class pyramid_reuse {
+        lifo,             // the last erased one, likely still in cache
+        address_order,    // the next one by address after the last reused, sweeping all pages
+        densest_page      // the next one by address in the most occupied page, sparse pages drain
+    }; // pyramid_reuse
+    
+    
+    // Generation checked reference to item of pyramid with generational layout,
+    // lower half is (page index, slot) of its node and upper half is its generation
+    struct pyramid_handle {
+        std::uint64_t value;
+        
+        bool operator == (pyramid_handle const& other) const noexcept {
+            return value == other.value;
+        }
+        
+        bool operator != (pyramid_handle const& other) const noexcept {
+            return value != other.value;
+        }
+    }; // pyramid_handle
+    
+    
+    namespace detail {
+        
+        // Allocator and ring of pages shared by pyramid containers. Container derives from it
+        // and provides init(), clear(), move_from(), emplace() and adopt_settings(),
+        // layout tells sizes of its nodes and pages
+        template<typename Container, typename Layout, typename G, typename A>
+        class pyramid_storage {
+        protected:
+            
+            using page_type = typename Layout::page;
+            using page_block = pyramid_page_block<Layout::alignment>;
+            using allocator_traits = std::allocator_traits<A>;
+            using page_allocator = typename allocator_traits::template rebind_alloc<page_block>;
+            using page_allocator_traits = std::allocator_traits<page_allocator>;
+            
+            static_assert(std::is_pointer_v<typename page_allocator_traits::pointer>,
+                          "Allocators with fancy pointers are not supported");
+            
+            A allocator_;
+            pyramid_size_type capacity_;
+            page_type pages_;  // sentinel, its previous page is the last allocated one
+            page_type* carving_page_;
+            pyramid_page_directory<page_type> directory_;
+            
+            
+            explicit pyramid_storage(A const& allocator) noexcept: allocator_{allocator} { }
+            
+            
+            explicit pyramid_storage(A&& allocator) noexcept: allocator_{std::move(allocator)} { }
+            
+            
+            void copy_assign(Container const& other) {
+                auto& self = container();
+                if(&self == &other)
+                    return;
+                if constexpr(allocator_traits::propagate_on_container_copy_assignment::value) {
+                    auto buffer = Container{other, other.allocator_};
+                    self.clear();
+                    allocator_ = other.allocator_;
+                    self.move_from(std::move(buffer));
+                } else {
+                    auto buffer = Container{other, allocator_};
+                    self.clear();
+                    self.move_from(std::move(buffer));
+                }
+            }
+            
+            
+            void move_assign(Container&& other) {
+                auto& self = container();
+                if(&self == &other)
+                    return;
+                self.clear();
+                if constexpr(allocator_traits::propagate_on_container_move_assignment::value) {
+                    allocator_ = std::move(other.allocator_);
+                    self.move_from(std::move(other));
+                } else {
+                    if(allocator_ == other.allocator_)
+                        self.move_from(std::move(other));
+                    else
+                        self.move_items_from(std::move(other));
+                }
+            }
+            
+            
+            // Serves move constructor taking allocator
+            void move_construct(Container&& other) {
+                auto& self = container();
+                if(allocator_ == other.allocator_) {
+                    self.move_from(std::move(other));
+                    return;
+                }
+                self.init();
+                self.move_items_from(std::move(other));
+            }
+            
+            
+            // Allocators are swapped only if they propagate on swap,
+            // otherwise they should be equal
+            void swap_with(Container& other) noexcept {
+                auto& self = container();
+                if(&self == &other)
+                    return;
+                if constexpr(allocator_traits::propagate_on_container_swap::value) {
+                    using std::swap;
+                    swap(allocator_, other.allocator_);
+                }
+                auto buffer = Container{allocator_};
+                buffer.move_from(std::move(self));
+                self.move_from(std::move(other));
+                other.move_from(std::move(buffer));
+            }
+            
+            
+            // For allocators that differ and do not propagate
+            void move_items_from(Container&& other) {
+                auto& self = container();
+                try {
+                    for(auto& item: other)
+                        self.emplace(std::move(item));
+                } catch(...) {
+                    self.clear();
+                    throw;
+                }
+                self.adopt_settings(other);
+                other.clear();
+            }
+            
+            
+            void init_pages() noexcept {
+                capacity_ = 0;
+                pages_.make_sentinel();
+                carving_page_ = &pages_;
+                directory_.clear();
+            }
+            
+            
+            // Hands the ring of pages over to uninitialized sentinel. Carving page
+            // is kept unless it is the sentinel, other is to be reset after
+            void take_pages(pyramid_storage& other) noexcept {
+                capacity_ = other.capacity_;
+                directory_ = std::move(other.directory_);
+                pages_.make_sentinel();
+                carving_page_ = &pages_;
+                if(other.pages_.next_page == &other.pages_)
+                    return;
+                pages_.next_page = other.pages_.next_page;
+                pages_.previous_page = other.pages_.previous_page;
+                pages_.next_page->previous_page = &pages_;
+                pages_.previous_page->next_page = &pages_;
+                if(other.carving_page_ != &other.pages_)
+                    carving_page_ = other.carving_page_;
+            }
+            
+            
+            // Items are to be destroyed before
+            void release_pages() noexcept {
+                auto* page = pages_.next_page;
+                while(page != &pages_) {
+                    auto* disposable = page;
+                    page = page->next_page;
+                    deallocate_page(disposable);
+                }
+                directory_.release();
+            }
+            
+            
+            // Page of capacity told by growth policy but no more than limit
+            // is linked at the end of the ring
+            page_type* allocate_page(pyramid_size_type limit) {
+                auto page_capacity = G::page_capacity(pyramid_growth::context{
+                    capacity_, pages_.previous_page->capacity, Layout::node_size, Layout::page_overhead});
+                if(page_capacity > limit)
+                    page_capacity = limit;
+                if(page_capacity > Layout::max_page_capacity)
+                    page_capacity = Layout::max_page_capacity;
+                if(page_capacity == 0
+                   || page_capacity > (~pyramid_size_type{0} - Layout::page_overhead - Layout::alignment) / (Layout::node_size + 1))
+                    throw std::bad_alloc{};
+                auto allocator = page_allocator{allocator_};
+                auto* new_page = reinterpret_cast<page_type*>(
+                    page_allocator_traits::allocate(allocator, page_blocks(page_capacity)));
+                new_page->capacity = page_capacity;
+                std::memset(static_cast<void*>(new_page->occupancy()), 0,
+                            pyramid_words(page_capacity) * sizeof(pyramid_size_type));
+                try {
+                    directory_.insert(new_page);
+                } catch(...) {
+                    deallocate_page(new_page);
+                    throw;
+                }
+                new_page->carved = 0;
+                new_page->size = 0;
+                pages_.append(new_page);
+                capacity_ += page_capacity;
+                return new_page;
+            }
+            
+            
+            // Nodes of the page are to be unlinked before
+            void release_page(page_type* page) noexcept {
+                directory_.erase(page);
+                page->unlink();
+                if(carving_page_ == page)
+                    carving_page_ = page->previous_page;
+                capacity_ -= page->capacity;
+                deallocate_page(page);
+            }
+            
+            
+            void deallocate_page(page_type* page) noexcept {
+                auto allocator = page_allocator{allocator_};
+                page_allocator_traits::deallocate(allocator,
+                                                  reinterpret_cast<page_block*>(page),
+                                                  page_blocks(page->capacity));
+            }
+            
+            
+            static pyramid_size_type page_blocks(pyramid_size_type page_capacity) noexcept {
+                auto const block_size = sizeof(page_block);
+                return (Layout::page_bytes(page_capacity) + block_size - 1) / block_size;
+            }
+        
+        
+        private:
+            
+            Container& container() noexcept {
+                return static_cast<Container&>(*this);
+            }
+        }; // pyramid_storage
+    
+    
+    } // namespace detail
+    
+    
+    template<typename T,
+             detail::pyramid_size_type F = 16,
+             typename G = pyramid_growth::geometric<F>,
+             typename A = std::allocator<T>,
+             typename L = pyramid_layout::interleaved>
+    class pyramid: detail::pyramid_storage<pyramid<T, F, G, A, L>, detail::pyramid_layout_traits<T, L>, G, A> {
+        
+        using layout = detail::pyramid_layout_traits<T, L>;
+        using storage = detail::pyramid_storage<pyramid, layout, G, A>;
+        using node_type = typename layout::node;
+        using page_type = typename layout::page;
+        using handle = typename layout::handle;
+        using table_type = typename layout::table;
+        using allocator_traits = std::allocator_traits<A>;
+        // Page table is kept on std::allocator like page directory
+        using table_allocator = std::allocator<node_type*>;
+        using table_allocator_traits = std::allocator_traits<table_allocator>;
+        
+        friend storage;
+        
+        static_assert(std::is_same_v<typename allocator_traits::value_type, T>,
+                      "Allocator should have the same value_type as pyramid");
+        
+        using storage::allocator_;
+        using storage::capacity_;
+        using storage::pages_;
+        using storage::carving_page_;
+        using storage::directory_;
+        detail::pyramid_size_type size_;
+        node_type free_nodes_;
+        node_type occupied_nodes_;
+        table_type table_;
+        typename layout::sentinel_table sentinel_table_;  // table of compact layout until the first page
+        bool growth_allowed_{true};
+        detail::pyramid_size_type release_watermark_{~detail::pyramid_size_type{0}};
+        pyramid_reuse reuse_{pyramid_reuse::lifo};
+        page_type* reuse_page_{nullptr};  // page swept for erased nodes unless policy is lifo
+        detail::pyramid_size_type reuse_slot_{0};
+        bool ordered_;  // nothing was erased, so occupied nodes follow pages and carving order
+        std::uint32_t generation_{0};  // of the last occupied node of generational layout
+        std::atomic<node_type*> returned_{nullptr};  // erased by other threads, shared layout only
+    
+    public:
+        
         using size_type = detail::pyramid_size_type;
         using value_type = T;
+        using growth_policy = G;
+        using allocator_type = A;
+        using layout_type = L;
         
         static size_type constexpr factor = F;
         
         
-        class iterator {
+        // Table to find nodes by handles is empty unless layout is compact,
+        // split layout keeps page directory there to find items of links
+        class iterator: table_type {
         friend class pyramid;
         friend class const_iterator;
-            detail::pyramid_node<T>* node_;
-           
-            iterator(detail::pyramid_node<T>* node): node_{node} { }
+            handle node_;
+            
+            iterator(handle node, table_type table): table_type(table), node_{node} { }
             
+            node_type* node() const noexcept {
+                return layout::at(*this, node_);
+            }
+        
         public:
             
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+            
             iterator(iterator const&) = default;
             iterator& operator = (iterator const&) = default;
             
@@ -78,310 +1044,1336 @@ namespace etceteras {
             }
             
             T& operator * () const noexcept {
-                return node_->data.item;
+                return *layout::item(*this, node());
             }
             
             T* operator -> () const noexcept {
-                return &node_->data.item;
+                return layout::item(*this, node());
             }
             
             iterator& operator ++ () noexcept {
-                node_ = node_->next_node;
+                node_ = node()->next_node;
                 return *this;
             }
-                        
+            
             iterator operator ++ (int) noexcept {
                 auto const last = *this;
-                node_ = node_->next_node;
+                node_ = node()->next_node;
                 return last;
             }
             
             iterator& operator -- () noexcept {
-                node_ = node_->previous_node;
+                node_ = node()->previous_node;
                 return *this;
             }
-
+            
             iterator operator -- (int) noexcept {
                 auto const last = *this;
-                node_ = node_->previous_node;
+                node_ = node()->previous_node;
+                return last;
+            }
+        
+        }; // iterator
+        
+        
+        class const_iterator: table_type {
+        friend class pyramid;
+            handle node_;
+            
+            const_iterator(handle node, table_type table): table_type(table), node_{node} { }
+            
+            node_type const* node() const noexcept {
+                return layout::at(*this, node_);
+            }
+        
+        public:
+            
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T const*;
+            using reference = T const&;
+            
+            const_iterator(const_iterator const&) = default;
+            const_iterator& operator = (const_iterator const&) = default;
+            const_iterator(iterator const& it) noexcept: table_type(it), node_{it.node_} { }
+            
+            bool operator == (const_iterator const& other) const noexcept {
+                return node_ == other.node_;
+            }
+            
+            bool operator != (const_iterator const& other) const noexcept {
+                return node_ != other.node_;
+            }
+            
+            T const& operator * () const noexcept {
+                return *layout::item(*this, const_cast<node_type*>(node()));
+            }
+            
+            T const* operator -> () const noexcept {
+                return layout::item(*this, const_cast<node_type*>(node()));
+            }
+            
+            const_iterator& operator ++ () noexcept {
+                node_ = node()->next_node;
+                return *this;
+            }
+            
+            const_iterator operator ++ (int) noexcept {
+                auto const last = *this;
+                node_ = node()->next_node;
+                return last;
+            }
+            
+            const_iterator& operator -- () noexcept {
+                node_ = node()->previous_node;
+                return *this;
+            }
+            
+            const_iterator operator -- (int) noexcept {
+                auto const last = *this;
+                node_ = node()->previous_node;
                 return last;
             }
-
-        }; // iterator
+        }; // const_iterator
+        
+        
+        pyramid() noexcept(noexcept(A())): pyramid(A()) { }
+        
+        
+        explicit pyramid(A const& allocator) noexcept: storage{allocator} {
+            init();
+        }
+        
+        
+        ~pyramid() {
+            clear();
+        }
+        
+        
+        pyramid(pyramid const& other)
+            : pyramid(other, allocator_traits::select_on_container_copy_construction(other.allocator_)) { }
+        
+        
+        pyramid(pyramid const& other, A const& allocator): storage{allocator} {
+            init();
+            copy_from(other);
+        }
+        
+        
+        pyramid& operator = (pyramid const& other) {
+            storage::copy_assign(other);
+            return *this;
+        }
+        
+        
+        pyramid(pyramid&& other) noexcept: storage{std::move(other.allocator_)} {
+            move_from(std::move(other));
+        }
+        
+        
+        pyramid(pyramid&& other, A const& allocator): storage{allocator} {
+            storage::move_construct(std::move(other));
+        }
+        
+        
+        pyramid& operator = (pyramid&& other)
+            noexcept(allocator_traits::propagate_on_container_move_assignment::value
+                     || allocator_traits::is_always_equal::value) {
+            storage::move_assign(std::move(other));
+            return *this;
+        }
+        
+        
+        // Allocators are swapped only if they propagate on swap,
+        // otherwise they should be equal
+        void swap(pyramid& other) noexcept {
+            storage::swap_with(other);
+        }
+        
+        
+        friend void swap(pyramid& x, pyramid& y) noexcept {
+            x.swap(y);
+        }
+        
+        
+        allocator_type get_allocator() const noexcept {
+            return allocator_;
+        }
+        
+        
+        size_type size() const noexcept {
+            return size_;
+        }
+        
+        
+        size_type capacity() const noexcept {
+            return capacity_;
+        }
+        
+        
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+        
+        
+        // Compact and generational layouts limit number of pages by their handles
+        size_type max_size() const noexcept {
+            if constexpr(layout::indexed) {
+                static auto const pages_capacity = indexed_max_size();
+                return pages_capacity;
+            } else {
+                return layout::max_size;
+            }
+        }
+        
+        
+        bool growth_allowed() const noexcept {
+            return growth_allowed_;
+        }
+        
+        
+        // When growth is not allowed, insert throws std::bad_alloc
+        // instead of allocating a page if there are no free nodes.
+        // Like other settings it goes along with items on copy, move and swap
+        void allow_growth(bool allowed) noexcept {
+            growth_allowed_ = allowed;
+        }
+        
+        
+        size_type release_watermark() const noexcept {
+            return release_watermark_;
+        }
+        
+        
+        // Pages emptied by erase are released as long as capacity exceeds
+        // size by more than watermark, by default they are kept
+        void release_watermark(size_type watermark) noexcept {
+            release_watermark_ = watermark;
+        }
+        
+        
+        pyramid_reuse reuse_policy() const noexcept {
+            return reuse_;
+        }
+        
+        
+        // Sweeping policies keep consecutive inserts at ascending addresses after churn,
+        // so insertion order traversal stays close to sequential
+        void reuse_policy(pyramid_reuse policy) noexcept {
+            reuse_ = policy;
+            reuse_page_ = nullptr;
+        }
+        
+        
+        // Releases pages without occupied nodes
+        void shrink_to_fit() noexcept {
+            for(auto* page = pages_.next_page; page != &pages_;) {
+                auto* next_page = page->next_page;
+                if(page->size == 0)
+                    release_page(page);
+                page = next_page;
+            }
+        }
+        
+        
+        size_type defragment(size_type budget = ~size_type{0}) {
+            return defragment(budget, [](T*, T*) { });
+        }
+        
+        
+        // Moves items of the sparsest pages to erased nodes of denser ones while they fit,
+        // at most budget items per call. Items keep their places in insertion order, but
+        // iterators to them are invalidated and relocated(from, to) is called after each move.
+        // Items that may throw on move stay in place, only free list is sorted by address.
+        // Returns number of moved items which is less than budget once there is nothing to move
+        template<typename Relocated>
+        size_type defragment(size_type budget, Relocated relocated) {
+            collect_returned();
+            auto moved = size_type{0};
+            if constexpr(std::is_nothrow_move_constructible_v<T>) {
+                page_type* target = nullptr;
+                auto target_slot = size_type{0};
+                for(auto* source = evacuated_page(); source != nullptr && moved != budget; source = evacuated_page()) {
+                    for(auto slot = size_type{0}; source->size != 0 && moved != budget; ++moved) {
+                        slot = detail::pyramid_next_bit<true>(source->occupancy(), slot, source->carved);
+                        if(target == nullptr || target == source || target->size == target->carved) {
+                            target = densest_reused_page(source);
+                            target_slot = 0;
+                        }
+                        target_slot = detail::pyramid_next_bit<false>(target->occupancy(), target_slot, target->carved);
+                        relocate(layout::handle_of(source, slot), layout::handle_of(target, target_slot), relocated);
+                    }
+                }
+            }
+            if(moved == budget)
+                return moved;
+            sort_free_list();
+            if(capacity_ - size_ > release_watermark_)
+                release_emptied_pages();
+            return moved;
+        }
+        
+        
+        // Allocates pages for at least n nodes regardless of allowed growth,
+        // prefault writes to never used nodes so that the OS maps them now.
+        // Occupancy bitmaps and items in use are left as they are
+        void reserve(size_type n, bool prefault = false) {
+            while(capacity_ < n)
+                allocate_page(n - capacity_);
+            if(!prefault)
+                return;
+            for(auto* page = pages_.next_page; page != &pages_; page = page->next_page) {
+                prefault_range(page->nodes + page->carved, page->nodes + page->capacity);
+                if constexpr(std::is_same_v<L, pyramid_layout::split>)
+                    prefault_range(layout::item(page, page->carved), layout::item(page, page->capacity));
+            }
+        }
+        
+        
+        // Only frees pages if items need no destruction
+        void clear() noexcept {
+            if constexpr(!detail::pyramid_trivially_destroyed<T, A>)
+                for(auto node = occupied_nodes_.next_node; node != occupied_list(); node = at(node)->next_node)
+                    allocator_traits::destroy(allocator_, layout::item(table_, at(node)));
+            storage::release_pages();
+            attach_directory();
+            if constexpr(layout::indexed)
+                if(table_.nodes != sentinel_table_) {
+                    auto allocator = table_allocator{};
+                    table_allocator_traits::deallocate(allocator, table_.nodes, layout::table_size);
+                }
+            init();
+        }
+        
+        
+        const_iterator begin() const noexcept {
+            return const_iterator{occupied_nodes_.next_node, table_};
+        }
+        
+        
+        const_iterator end() const noexcept {
+            return const_iterator{occupied_list(), table_};
+        }
+        
+        
+        iterator begin() {
+            return iterator{occupied_nodes_.next_node, table_};
+        }
+        
+        
+        iterator end() {
+            return iterator{occupied_list(), table_};
+        }
+        
+        
+        // Item should be in pyramid. Interleaved nodes begin with their items,
+        // other layouts look for the page by binary search among pages
+        iterator iterator_to(T& item) noexcept {
+            return iterator{handle_of_item(&item), table_};
+        }
+        
+        
+        const_iterator iterator_to(T const& item) const noexcept {
+            return const_iterator{handle_of_item(&item), table_};
+        }
+        
+        
+        // Follows Chains parts of insertion order at once, so that cache misses on their
+        // nodes overlap instead of stalling one after another. Parts start at the first
+        // item and at items spread over pages, order is kept within each part only.
+        // f should neither insert nor erase items
+        template<size_type Chains = 8, typename Function>
+        void for_each_interleaved(Function&& f) {
+            static_assert(Chains > 0, "There should be at least one chain");
+            handle starts[Chains];
+            handle nodes[Chains];
+            auto const chains = chain_starts(starts);
+            std::copy(starts, starts + chains, nodes);
+            for(auto active = chains; active != 0;) {
+                for(auto chain = size_type{0}; chain < active;) {
+                    auto* const node = at(nodes[chain]);
+                    auto const next_node = node->next_node;
+                    detail::pyramid_prefetch(at(next_node), sizeof(node_type));
+                    f(*layout::item(table_, node));
+                    if(next_node == occupied_list() || std::find(starts, starts + chains, next_node) != starts + chains)
+                        nodes[chain] = nodes[--active];
+                    else
+                        nodes[chain++] = next_node;
+                }
+            }
+        }
+        
+        
+        template<size_type Chains = 8, typename Function>
+        void for_each_interleaved(Function&& f) const {
+            const_cast<pyramid&>(*this).template for_each_interleaved<Chains>([&f](T& item) { f(std::as_const(item)); });
+        }
+        
+        
+        // Visits items page by page in order of their addresses skipping vacant
+        // nodes by occupancy bitmaps, f should neither insert nor erase items
+        template<typename Function>
+        void for_each_unordered(Function&& f) {
+            for(auto* page: directory_) {
+                auto const items = items_of(page);
+                if(page->size == page->carved) {
+                    for(auto slot = size_type{0}; slot != page->carved; ++slot)
+                        f(items[slot]);
+                    continue;
+                }
+                auto* words = page->occupancy();
+                auto remaining = page->size;
+                for(auto base = size_type{0}; remaining != 0; base += detail::pyramid_word_bits) {
+                    for(auto word = *words++; word != 0; word &= word - 1) {
+                        f(items[base + detail::pyramid_trailing_zeros(word)]);
+                        --remaining;
+                    }
+                }
+            }
+        }
+        
+        
+        template<typename Function>
+        void for_each_unordered(Function&& f) const {
+            const_cast<pyramid&>(*this).for_each_unordered([&f](T& item) { f(std::as_const(item)); });
+        }
+        
+        
+        // Passes maximal runs of adjacent occupied nodes of each page as strided_span<T>
+        // page by page in order of their addresses, f should neither insert nor erase items
+        template<typename Function>
+        void for_each_run(Function&& f) {
+            for(auto* page: directory_) {
+                auto const items = items_of(page);
+                if(page->size == page->carved) {
+                    if(page->size != 0)
+                        f(items);
+                    continue;
+                }
+                auto const* const words = page->occupancy();
+                auto remaining = page->size;
+                for(auto first = size_type{0}; remaining != 0;) {
+                    first = detail::pyramid_next_bit<true>(words, first, page->carved);
+                    auto const last = detail::pyramid_next_bit<false>(words, first, page->carved);
+                    f(strided_span<T>{&items[first], last - first, layout::stride});
+                    remaining -= last - first;
+                    first = last;
+                }
+            }
+        }
         
         
-        class const_iterator {
+        template<typename Function>
+        void for_each_run(Function&& f) const {
+            const_cast<pyramid&>(*this).for_each_run([&f](strided_span<T> run) {
+                f(strided_span<T const>{run.data(), run.size(), run.stride()});
+            });
+        }
+        
+        
+        // Up to grain adjacent nodes of one page, chunks do not share items,
+        // so different threads may visit them at once
+        class chunk {
         friend class pyramid;
-            detail::pyramid_node<T> const* node_;
-            
-            const_iterator(detail::pyramid_node<T> const* node) : node_{node} { }
+            strided_span<T> items_;
+            size_type const* words_;  // nullptr if all nodes of page are occupied
+            size_type first_;
+            size_type last_;
             
+            chunk(strided_span<T> items, size_type const* words, size_type first, size_type last) noexcept
+                : items_{items}, words_{words}, first_{first}, last_{last} { }
+        
         public:
             
-            const_iterator(const_iterator const&) = default;
-            const_iterator& operator = (const_iterator const&) = default;
-            const_iterator(iterator const& it) noexcept: node_{it.node_} { }
-            
-            bool operator == (const_iterator const& other) const noexcept {
-                return node_ == other.node_;
-            }
-            
-            bool operator != (const_iterator const& other) const noexcept {
-                return node_ != other.node_;
-            }
-            
-            T const& operator * () const noexcept {
-                return node_->data.item;
-            }
-            
-            T const* operator -> () const noexcept {
-                return &node_->data.item;
-            }
-            
-            const_iterator& operator ++ () noexcept {
-                node_ = node_->next_node;
-                return *this;
-            }
-            
-            const_iterator operator ++ (int) noexcept {
-                auto const last = *this;
-                node_ = node_->next_node;
-                return last;
-            }
-            
-            iterator& operator -- () noexcept {
-                node_ = node_->previous_node;
-                return *this;
+            template<typename Function>
+            void for_each(Function&& f) const {
+                if(words_ == nullptr) {
+                    for(auto slot = first_; slot != last_; ++slot)
+                        f(items_[slot]);
+                    return;
+                }
+                for(auto base = first_; base < last_; base += detail::pyramid_word_bits)
+                    for(auto word = words_[base / detail::pyramid_word_bits]; word != 0; word &= word - 1)
+                        f(items_[base + detail::pyramid_trailing_zeros(word)]);
             }
-
-            iterator operator -- (int) noexcept {
-                auto const last = *this;
-                node_ = node_->previous_node;
-                return last;
+        }; // chunk
+        
+        
+        // Cuts pages into chunks of grain nodes rounded up to whole words of occupancy
+        // bitmap and passes them in order of page addresses skipping empty pages
+        template<typename Function>
+        void for_each_chunk(size_type grain, Function&& f) {
+            grain = std::max((grain + detail::pyramid_word_bits - 1) / detail::pyramid_word_bits, size_type{1})
+                * detail::pyramid_word_bits;
+            for(auto* page: directory_) {
+                if(page->size == 0)
+                    continue;
+                auto const* words = page->size == page->carved ? nullptr : page->occupancy();
+                for(auto first = size_type{0}; first < page->carved; first += grain)
+                    f(chunk{items_of(page), words, first, std::min(first + grain, page->carved)});
             }
-        }; // const_iterator
+        }
         
         
-        pyramid() noexcept {
-            init();
+        
+        iterator insert(T const& item) {
+            return emplace(item);
         }
         
         
-        ~pyramid() {
-            clear();
+        iterator insert(T&& item) {
+            return emplace(std::move(item));
         }
         
         
-        pyramid(pyramid const& other) {
-            init();
-            for(auto const& item: other)
-                insert(item);
+        // Constructs item right in a node, if constructor throws
+        // pyramid stays as it was except for a possibly allocated page
+        template<typename... Args>
+        iterator emplace(Args&&... args) {
+            auto const node = vacant_node();
+            allocator_traits::construct(allocator_, layout::item(table_, at(node)), std::forward<Args>(args)...);
+            occupy_node(node);
+            return iterator{node, table_};
         }
         
         
-        pyramid& operator = (pyramid const& other) {
-            auto buffer = other;
-            *this = std::move(buffer);
-            return *this;
+        // Inserts items in order, if any of them throws pyramid stays as it was
+        // except for possibly allocated pages. Returns iterator to the first
+        // inserted item or end() if there were none
+        template<typename InputIt>
+        iterator insert(InputIt first, InputIt last) {
+            using category = typename std::iterator_traits<InputIt>::iterator_category;
+            if constexpr(std::is_base_of_v<std::forward_iterator_tag, category>) {
+                auto const n = static_cast<size_type>(std::distance(first, last));
+                // Iterator is advanced first, so item is never left constructed if it throws
+                return insert_batch(n, [this, &first](T* item) {
+                    auto const source = first;
+                    ++first;
+                    allocator_traits::construct(allocator_, item, *source);
+                });
+            } else {
+                auto const last_before = occupied_nodes_.previous_node;
+                try {
+                    for(; first != last; ++first)
+                        emplace(*first);
+                } catch(...) {
+                    erase(iterator{at(last_before)->next_node, table_}, end());
+                    throw;
+                }
+                return iterator{at(last_before)->next_node, table_};
+            }
         }
         
         
-        pyramid(pyramid&& other) {
-            move_from(std::move(other));
+        iterator insert(std::initializer_list<T> items) {
+            return insert(items.begin(), items.end());
         }
         
         
-        pyramid& operator = (pyramid&& other) {
-            clear();
-            move_from(std::move(other));
-            return *this;
+        iterator insert_n(size_type n, T const& item) {
+            return insert_batch(n, [this, &item](T* copy) {
+                allocator_traits::construct(allocator_, copy, item);
+            });
         }
         
         
-        size_type size() const noexcept {
-            return size_;
+        // Takes log of page count to find the page of node unless layout is compact
+        // or generational. Page emptied beyond release watermark is freed in constant time
+        const_iterator erase(const_iterator it) {
+            return const_iterator{free_node(it.node_), table_};
         }
         
         
-        size_type capacity() const noexcept {
-            return capacity_;
+        iterator erase(iterator it) {
+            return iterator{free_node(it.node_), table_};
         }
         
         
-        bool empty() const noexcept {
-            return size_ == 0;
+        // For items that know only their own address, takes log of page count with any layout
+        iterator erase(T* item) {
+            return iterator{free_node(handle_of_item(item)), table_};
         }
         
         
-        void clear() noexcept {
-            for(auto* node = occupied_nodes_.next_node;
-                node != &occupied_nodes_;
-                node = node->next_node)
-                    node->data.item.~T();
-            auto* page = pages_.next_page;
-            while(page != &pages_) {
-                auto* disposable = page;
-                page = page->next_page;
-                std::free(disposable);
+        // Erased nodes are still linked, so they go to the free list as one run
+        iterator erase(iterator first, iterator last) {
+            if(first == last)
+                return last;
+            auto const run_first = first.node_;
+            auto const run_last = at(last.node_)->previous_node;
+            auto erased = size_type{0};
+            for(auto node = run_first; node != last.node_; node = at(node)->next_node) {
+                auto* page = page_of(node);
+                allocator_traits::destroy(allocator_, item_of(page, node));
+                unstamp(at(node));
+                --page->size;
+                page->vacate(layout::slot_of(page, node));
+                ++erased;
             }
-            init();
+            at(at(run_first)->previous_node)->next_node = last.node_;
+            at(last.node_)->previous_node = at(run_first)->previous_node;
+            free_run(run_first, run_last, erased);
+            return last;
         }
-
         
-        const_iterator begin() const noexcept {
-            return const_iterator{occupied_nodes_.next_node};
+        
+        const_iterator erase(const_iterator first, const_iterator last) {
+            erase(iterator{first.node_, table_}, iterator{last.node_, table_});
+            return last;
         }
         
         
-        const_iterator end() const noexcept {
-            return const_iterator{&occupied_nodes_};
-        }
-
-
-        iterator begin() {
-            return iterator{occupied_nodes_.next_node};
+        // Erases items satisfying predicate, returns number of erased items
+        template<typename Predicate>
+        size_type erase_if(Predicate predicate) {
+            auto run_first = handle{};
+            auto run_last = handle{};
+            auto erased = size_type{0};
+            try {
+                auto node = occupied_nodes_.next_node;
+                while(node != occupied_list()) {
+                    auto* const erasable = at(node);
+                    auto const next_node = erasable->next_node;
+                    auto* const item = layout::item(table_, erasable);
+                    if(predicate(std::as_const(*item))) {
+                        allocator_traits::destroy(allocator_, item);
+                        unstamp(erasable);
+                        auto* page = page_of(node);
+                        --page->size;
+                        page->vacate(layout::slot_of(page, node));
+                        at(erasable->previous_node)->next_node = next_node;
+                        at(next_node)->previous_node = erasable->previous_node;
+                        if(erased != 0)
+                            at(run_last)->next_node = node;
+                        else
+                            run_first = node;
+                        erasable->previous_node = run_last;
+                        run_last = node;
+                        ++erased;
+                    }
+                    node = next_node;
+                }
+            } catch(...) {
+                if(erased != 0)
+                    free_run(run_first, run_last, erased);
+                throw;
+            }
+            if(erased != 0)
+                free_run(run_first, run_last, erased);
+            return erased;
         }
         
         
-        iterator end() {
-            return iterator{&occupied_nodes_};
+        // Handle stays valid until item is erased
+        pyramid_handle handle_of(const_iterator it) const noexcept {
+            static_assert(layout::generational, "Handles need generational layout");
+            return pyramid_handle{std::uint64_t{at(it.node_)->generation} << 32 | it.node_};
         }
-
         
         
-        iterator insert(T const& item) {
-            auto* node = allocate_node();
-            new(node->data.buffer) T(item);
-            return iterator{node};
+        // Checks page index, slot and generation, nullptr if item was erased
+        T* get(pyramid_handle h) noexcept {
+            static_assert(layout::generational, "Handles need generational layout");
+            auto const node = handle(h.value);
+            auto const generation = std::uint32_t(h.value >> 32);
+            auto const index = node >> layout::slot_bits;
+            if(generation == 0 || index < 2 || table_.nodes == sentinel_table_ || table_.nodes[index] == nullptr)
+                return nullptr;
+            auto* page = page_of(node);
+            if(layout::slot_of(page, node) >= page->carved || at(node)->generation != generation)
+                return nullptr;
+            return layout::item(table_, at(node));
         }
         
         
-        iterator insert(T&& item) {
-            auto* node = allocate_node();
-            new(node->data.buffer) T(std::move(item));
-            return iterator{node};
+        T const* get(pyramid_handle h) const noexcept {
+            return const_cast<pyramid&>(*this).get(h);
         }
         
         
-        const_iterator erase(const_iterator it) {
-            return const_iterator{free_node(it.node_)};
+        // Returns false if item was already erased
+        bool erase(pyramid_handle h) {
+            if(get(h) == nullptr)
+                return false;
+            free_node(handle(h.value));
+            return true;
         }
         
         
-        iterator erase(iterator it) {
-            return iterator{free_node(it.node_)};
+        // May be called by any thread, item stays in pyramid until the owner
+        // collects returned nodes, what it does before taking vacant ones
+        void remote_erase(const_iterator it) noexcept {
+            static_assert(layout::returnable, "Remote erase needs shared layout");
+            auto* node = it.node_;
+            auto* head = returned_.load(std::memory_order_relaxed);
+            do
+                node->next_returned = head;
+            while(!returned_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
         }
-
         
-    private:
+        
+        // Erases items returned by remote_erase, returns their number
+        size_type collect_returned() {
+            if constexpr(layout::returnable) {
+                if(returned_.load(std::memory_order_relaxed) == nullptr)
+                    return 0;
+                auto collected = size_type{0};
+                for(auto* node = returned_.exchange(nullptr, std::memory_order_acquire); node != nullptr; ++collected) {
+                    auto* next = node->next_returned;
+                    free_node(node);
+                    node = next;
+                }
+                return collected;
+            } else {
+                return 0;
+            }
+        }
+    
     
+    private:
+        
         void init() {
-            capacity_ = 0;
+            storage::init_pages();
             size_ = 0;
-            pages_.next_page = &pages_;
-            pages_.capacity = 0;
-            next_page_estimate_ = F;
-            free_nodes_.previous_node = &free_nodes_;
-            free_nodes_.next_node = &free_nodes_;
-            occupied_nodes_.previous_node = &occupied_nodes_;
-            occupied_nodes_.next_node = &occupied_nodes_;
+            reuse_page_ = nullptr;
+            reuse_slot_ = 0;
+            returned_.store(nullptr, std::memory_order_relaxed);
+            ordered_ = true;
+            attach_table(sentinel_table_);
+            free_nodes_.previous_node = free_list();
+            free_nodes_.next_node = free_list();
+            occupied_nodes_.previous_node = occupied_list();
+            occupied_nodes_.next_node = occupied_list();
+        }
+        
+        
+        // Compact layout finds sentinels through the first entries of page table,
+        // the small sentinel table serves until there are pages
+        template<typename Nodes>
+        void attach_table(Nodes& nodes) noexcept {
+            if constexpr(layout::indexed) {
+                sentinel_table_[0] = &free_nodes_;
+                sentinel_table_[1] = &occupied_nodes_;
+                table_.nodes = nodes;
+                table_.nodes[0] = &free_nodes_;
+                table_.nodes[1] = &occupied_nodes_;
+            }
+        }
+        
+        
+        // Split layout iterators look pages of links up in directory
+        void attach_directory() noexcept {
+            if constexpr(std::is_same_v<L, pyramid_layout::split>)
+                table_.pages = directory_.pages();
+        }
+        
+        
+        handle free_list() const noexcept {
+            if constexpr(layout::indexed)
+                return layout::free_list;
+            else
+                return const_cast<node_type*>(&free_nodes_);
+        }
+        
+        
+        handle occupied_list() const noexcept {
+            if constexpr(layout::indexed)
+                return layout::occupied_list;
+            else
+                return const_cast<node_type*>(&occupied_nodes_);
+        }
+        
+        
+        node_type* at(handle node) const noexcept {
+            return layout::at(table_, node);
+        }
+        
+        
+        handle handle_of_item(T const* item) const noexcept {
+            if constexpr(std::is_same_v<L, pyramid_layout::interleaved> || std::is_same_v<L, pyramid_layout::shared>) {
+                return layout::handle_of(const_cast<T*>(item));
+            } else {
+                auto* page = directory_.page_of(item);
+                return layout::handle_of(page, layout::slot_of(page, item));
+            }
         }
         
         
+        // Also serves move constructors, sentinel page is set up by taking pages
         void move_from(pyramid&& other) {
-            capacity_ = other.capacity_;
+            adopt_settings(other);
+            storage::take_pages(other);
             size_ = other.size_;
-            next_page_estimate_ = other.next_page_estimate_;
-            if(other.pages_.next_page == &other.pages_) {
-                pages_.next_page = &pages_;
-            } else {
-                pages_.next_page = other.pages_.next_page;
-                auto* last_page = other.pages_.next_page;
-                while(last_page->next_page != &other.pages_)
-                    last_page = last_page->next_page;
-                last_page->next_page = &pages_;
+            attach_directory();
+            ordered_ = other.ordered_;
+            generation_ = std::max(generation_, other.generation_);
+            returned_.store(other.returned_.exchange(nullptr, std::memory_order_acquire), std::memory_order_relaxed);
+            reuse_page_ = other.reuse_page_;
+            reuse_slot_ = other.reuse_slot_;
+            if constexpr(layout::indexed) {
+                if(other.table_.nodes == other.sentinel_table_)
+                    attach_table(sentinel_table_);
+                else
+                    attach_table(other.table_.nodes);
             }
-            if(other.free_nodes_.next_node == &other.free_nodes_) {
-                free_nodes_.next_node = &free_nodes_;
+            if(other.free_nodes_.next_node == other.free_list()) {
+                free_nodes_.next_node = free_list();
             } else {
                 free_nodes_.next_node = other.free_nodes_.next_node;
-                free_nodes_.next_node->previous_node = &free_nodes_;
+                at(free_nodes_.next_node)->previous_node = free_list();
             }
-            if(other.free_nodes_.previous_node == &other.free_nodes_) {
-                free_nodes_.previous_node = &free_nodes_;
+            if(other.free_nodes_.previous_node == other.free_list()) {
+                free_nodes_.previous_node = free_list();
             } else {
                 free_nodes_.previous_node = other.free_nodes_.previous_node;
-                free_nodes_.previous_node->next_node = &free_nodes_;
+                at(free_nodes_.previous_node)->next_node = free_list();
             }
-            if(other.occupied_nodes_.next_node == &other.occupied_nodes_) {
-                occupied_nodes_.next_node = &occupied_nodes_;
+            if(other.occupied_nodes_.next_node == other.occupied_list()) {
+                occupied_nodes_.next_node = occupied_list();
             } else {
                 occupied_nodes_.next_node = other.occupied_nodes_.next_node;
-                occupied_nodes_.next_node->previous_node = &occupied_nodes_;
+                at(occupied_nodes_.next_node)->previous_node = occupied_list();
             }
-            if(other.occupied_nodes_.previous_node == &other.occupied_nodes_) {
-                occupied_nodes_.previous_node = &occupied_nodes_;
+            if(other.occupied_nodes_.previous_node == other.occupied_list()) {
+                occupied_nodes_.previous_node = occupied_list();
             } else {
                 occupied_nodes_.previous_node = other.occupied_nodes_.previous_node;
-                occupied_nodes_.previous_node->next_node = &occupied_nodes_;
+                at(occupied_nodes_.previous_node)->next_node = occupied_list();
             }
             other.init();
-
         }
-
-    
-        detail::pyramid_node<T>* allocate_node() {
+        
+        
+        void copy_from(pyramid const& other) {
+            generation_ = std::max(generation_, other.generation_);
+            try {
+                if constexpr(detail::pyramid_trivially_copied<T, A>)
+                    if(other.ordered_) {
+                        copy_pages_from(other);
+                        adopt_settings(other);
+                        return;
+                    }
+                insert(other.begin(), other.end());
+            } catch(...) {
+                clear();
+                throw;
+            }
+            adopt_settings(other);
+        }
+        
+        
+        // Taken after items, so that copies are not stopped by disallowed growth
+        void adopt_settings(pyramid const& other) noexcept {
+            growth_allowed_ = other.growth_allowed_;
+            release_watermark_ = other.release_watermark_;
+            reuse_ = other.reuse_;
+        }
+        
+        
+        // Items of ordered pyramid lie in its pages one after another, so
+        // they are copied by spans of nodes and links are fixed up after
+        void copy_pages_from(pyramid const& other) {
+            ensure_vacancies(other.size_);
+            auto* source = other.pages_.next_page;
+            auto source_offset = size_type{0};
+            auto previous = occupied_list();
+            auto copied = size_type{0};
+            for(auto* page = pages_.next_page; copied != other.size_; page = page->next_page) {
+                auto const count = std::min(page->capacity, other.size_ - copied);
+                for(auto filled = size_type{0}; filled != count;) {
+                    while(source_offset == source->carved) {
+                        source = source->next_page;
+                        source_offset = 0;
+                    }
+                    auto const span = std::min(source->carved - source_offset, count - filled);
+                    layout::copy(page, filled, source, source_offset, span);
+                    filled += span;
+                    source_offset += span;
+                }
+                for(auto slot = size_type{0}; slot != count; ++slot) {
+                    auto* node = page->nodes + slot;
+                    auto const copy = layout::handle_of(page, slot);
+                    node->previous_node = previous;
+                    at(previous)->next_node = copy;
+                    previous = copy;
+                    page->occupy(slot);
+                }
+                page->carved = count;
+                page->size = count;
+                carving_page_ = page;
+                copied += count;
+            }
+            at(previous)->next_node = occupied_list();
+            occupied_nodes_.previous_node = previous;
+            size_ = other.size_;
+        }
+        
+        
+        // Items erased by other threads are not moved along
+        void move_items_from(pyramid&& other) {
+            other.collect_returned();
+            storage::move_items_from(std::move(other));
+        }
+        
+        
+        // Never used nodes are carved one by one from pages in order of their
+        // allocation and reach the free list only after being erased.
+        // Vacant node is the next one to occupy, nothing is changed until then
+        handle vacant_node() {
+            collect_returned();
             if(capacity_ == size_) {
-                auto const page_capacity = next_page_estimate_ - size_;
-                auto const next_page_estimate = next_page_estimate_ * F;
-                if(next_page_estimate < next_page_estimate_)
+                if(!growth_allowed_)
                     throw std::bad_alloc{};
-                next_page_estimate_ = next_page_estimate;
-                auto const page_size = sizeof(detail::pyramid_page<T>);
-                auto const nodes_size = (page_capacity - 1) * sizeof(detail::pyramid_node<T>);
-                auto* new_page = static_cast<detail::pyramid_page<T>*>(std::malloc(page_size + nodes_size));
-                if(!new_page)
+                allocate_page(~size_type{0});
+            }
+            if(free_nodes_.next_node != free_list()) {
+                if(reuse_ != pyramid_reuse::lifo)
+                    relink_free_node(reused_node(), free_list());
+                return free_nodes_.next_node;
+            }
+            auto* page = carving_page_;
+            while(page->carved == page->capacity)
+                page = page->next_page;
+            carving_page_ = page;
+            return layout::handle_of(page, page->carved);
+        }
+        
+        
+        // Makes sure n nodes can be occupied without allocation
+        void ensure_vacancies(size_type n) {
+            collect_returned();
+            while(capacity_ - size_ < n) {
+                if(!growth_allowed_)
                     throw std::bad_alloc{};
-                new_page->next_page = pages_.next_page;
-                new_page->capacity = page_capacity;
-                pages_.next_page = new_page;
-                for(auto* node = new_page->nodes; node != new_page->nodes + page_capacity; ++node) {
-                    node->previous_node = node - 1;
-                    node->next_node = node + 1;
+                allocate_page(~size_type{0});
+            }
+        }
+        
+        
+        // Takes n nodes as one chain, erased nodes as a run of free list and the
+        // rest carved. Constructs items along the chain with construct(T*)
+        // and splices the chain at the end of occupied list.
+        template<typename Construct>
+        iterator insert_batch(size_type n, Construct construct) {
+            if(n == 0)
+                return end();
+            ensure_vacancies(n);
+            auto chain_first = handle{};
+            auto chain_last = free_list();
+            auto taken = size_type{0};
+            while(taken != n && at(chain_last)->next_node != free_list()) {
+                if(reuse_ != pyramid_reuse::lifo)
+                    relink_free_node(reused_node(), chain_last);
+                chain_last = at(chain_last)->next_node;
+                stamp(at(chain_last));
+                auto* page = page_of(chain_last);
+                ++page->size;
+                page->occupy(layout::slot_of(page, chain_last));
+                ++taken;
+            }
+            if(taken != 0) {
+                chain_first = free_nodes_.next_node;
+                free_nodes_.next_node = at(chain_last)->next_node;
+                at(free_nodes_.next_node)->previous_node = free_list();
+            }
+            for(auto* page = carving_page_; taken != n; page = page->next_page) {
+                auto const carving = std::min(page->capacity - page->carved, n - taken);
+                for(auto slot = page->carved; slot != page->carved + carving; ++slot) {
+                    auto* node = page->nodes + slot;
+                    auto const carved = layout::handle_of(page, slot);
+                    stamp(node);
+                    node->previous_node = chain_last;
+                    if(taken != 0)
+                        at(chain_last)->next_node = carved;
+                    else
+                        chain_first = carved;
+                    chain_last = carved;
+                    page->occupy(slot);
+                    ++taken;
                 }
-                new_page->nodes[0].previous_node = &free_nodes_;
-                free_nodes_.next_node = new_page->nodes;
-                new_page->nodes[page_capacity - 1].next_node = &free_nodes_;
-                free_nodes_.previous_node = new_page->nodes + page_capacity - 1;
-                capacity_ += page_capacity;
+                page->carved += carving;
+                page->size += carving;
+                if(carving != 0)
+                    carving_page_ = page;
+            }
+            auto node = chain_first;
+            try {
+                for(; node != chain_last; node = at(node)->next_node)
+                    construct(layout::item(table_, at(node)));
+                construct(layout::item(table_, at(node)));
+            } catch(...) {
+                for(auto constructed = chain_first; constructed != node; constructed = at(constructed)->next_node)
+                    allocator_traits::destroy(allocator_, layout::item(table_, at(constructed)));
+                for(auto taken_node = chain_first;; taken_node = at(taken_node)->next_node) {
+                    unstamp(at(taken_node));
+                    auto* page = page_of(taken_node);
+                    --page->size;
+                    page->vacate(layout::slot_of(page, taken_node));
+                    if(taken_node == chain_last)
+                        break;
+                }
+                at(chain_first)->previous_node = free_list();
+                at(chain_last)->next_node = free_nodes_.next_node;
+                at(free_nodes_.next_node)->previous_node = chain_last;
+                free_nodes_.next_node = chain_first;
+                ordered_ = false;
+                throw;
+            }
+            at(chain_first)->previous_node = occupied_nodes_.previous_node;
+            at(occupied_nodes_.previous_node)->next_node = chain_first;
+            at(chain_last)->next_node = occupied_list();
+            occupied_nodes_.previous_node = chain_last;
+            size_ += n;
+            return iterator{chain_first, table_};
+        }
+        
+        
+        void occupy_node(handle vacant) noexcept {
+            auto* node = at(vacant);
+            stamp(node);
+            if(vacant == free_nodes_.next_node) {
+                at(node->next_node)->previous_node = free_list();
+                free_nodes_.next_node = node->next_node;
+                auto* page = page_of(vacant);
+                ++page->size;
+                page->occupy(layout::slot_of(page, vacant));
+            } else {
+                ++carving_page_->carved;
+                ++carving_page_->size;
+                carving_page_->occupy(layout::slot_of(carving_page_, vacant));
             }
-            auto* allocated_node = free_nodes_.next_node;
-            allocated_node->next_node->previous_node = allocated_node->previous_node;
-            allocated_node->previous_node->next_node = allocated_node->next_node;
-            allocated_node->next_node = &occupied_nodes_;
-            allocated_node->previous_node = occupied_nodes_.previous_node;
-            occupied_nodes_.previous_node->next_node = allocated_node;
-            occupied_nodes_.previous_node = allocated_node;
+            node->next_node = occupied_list();
+            node->previous_node = occupied_nodes_.previous_node;
+            at(occupied_nodes_.previous_node)->next_node = vacant;
+            occupied_nodes_.previous_node = vacant;
             ++size_;
-            return allocated_node;
         }
         
         
-        detail::pyramid_node<T>* free_node(detail::pyramid_node<T>* node) {
-            auto* next_node = node->next_node;
-            node->data.item.~T();
-            node->previous_node->next_node = node->next_node;
-            node->next_node->previous_node = node->previous_node;
-            node->previous_node = &free_nodes_;
+        // Page index of compact layout is taken first, the page table may come with it
+        void allocate_page(size_type limit) {
+            auto const index = vacant_page_index();
+            auto* new_page = storage::allocate_page(limit);
+            new_page->index = index;
+            attach_directory();
+            if constexpr(layout::indexed)
+                table_.nodes[index] = new_page->nodes;
+        }
+        
+        
+        // Steps from unaligned first may jump over the OS page of the last byte, so it is touched too
+        static void prefault_range(void* first, void* last) noexcept {
+            auto* byte = static_cast<char volatile*>(first);
+            auto* const end = static_cast<char volatile*>(last);
+            if(byte >= end)
+                return;
+            for(; byte < end; byte += detail::pyramid_prefault_stride)
+                *byte = 0;
+            *(end - 1) = 0;
+        }
+        
+        
+        // Capacity of all pages of page table as growth policy makes them one by one
+        static size_type indexed_max_size() noexcept {
+            auto capacity = size_type{0};
+            auto last_page = size_type{0};
+            for(auto index = size_type{2}; index != layout::table_size; ++index) {
+                last_page = std::min(G::page_capacity(pyramid_growth::context{
+                    capacity, last_page, layout::node_size, layout::page_overhead}), layout::max_page_capacity);
+                capacity += last_page;
+            }
+            return capacity;
+        }
+        
+        
+        // Compact layout allocates full page table along with the first page
+        size_type vacant_page_index() {
+            if constexpr(layout::indexed) {
+                if(table_.nodes == sentinel_table_) {
+                    auto allocator = table_allocator{};
+                    auto* nodes = table_allocator_traits::allocate(allocator, layout::table_size);
+                    std::fill(nodes, nodes + layout::table_size, nullptr);
+                    attach_table(nodes);
+                }
+                for(auto index = size_type{2}; index != layout::table_size; ++index)
+                    if(table_.nodes[index] == nullptr)
+                        return index;
+                throw std::length_error{"pyramid has no vacant page indices"};
+            } else {
+                return 0;
+            }
+        }
+        
+        
+        // Free nodes of the page are unlinked, never used ones are not in any list
+        void release_page(page_type* page) noexcept {
+            for(auto* node = page->nodes; node != page->nodes + page->carved; ++node) {
+                at(node->previous_node)->next_node = node->next_node;
+                at(node->next_node)->previous_node = node->previous_node;
+            }
+            if constexpr(layout::indexed)
+                table_.nodes[page->index] = nullptr;
+            if(reuse_page_ == page)
+                reuse_page_ = nullptr;
+            storage::release_page(page);
+        }
+        
+        
+        // Compact handles point to page table, pointers are looked up in page directory.
+        // It takes log of page count, which grows with the live set under fixed and budgeted growth
+        page_type* page_of(handle node) const noexcept {
+            if constexpr(layout::indexed) {
+                auto const nodes_offset = reinterpret_cast<unsigned char const*>(pages_.nodes)
+                    - reinterpret_cast<unsigned char const*>(&pages_);
+                auto* const nodes = reinterpret_cast<unsigned char*>(table_.nodes[node >> layout::slot_bits]);
+                return reinterpret_cast<page_type*>(nodes - nodes_offset);
+            } else {
+                return directory_.page_of(node);
+            }
+        }
+        
+        
+        // Split layout takes item from the page at hand instead of looking the page up again
+        T* item_of(page_type* page, handle node) const noexcept {
+            if constexpr(std::is_same_v<L, pyramid_layout::split>)
+                return layout::item(page, layout::slot_of(page, node));
+            else
+                return layout::item(table_, at(node));
+        }
+        
+        
+        static strided_span<T> items_of(page_type* page) noexcept {
+            return strided_span<T>{layout::item(page, 0), page->carved, layout::stride};
+        }
+        
+        
+        // Erased node to reuse by policy, there should be some. Sweep goes on
+        // from the last reused node and picks another page at the end of one
+        handle reused_node() noexcept {
+            if(reuse_page_ != nullptr) {
+                reuse_slot_ = detail::pyramid_next_bit<false>(reuse_page_->occupancy(), reuse_slot_,
+                                                              reuse_page_->carved);
+                if(reuse_slot_ != reuse_page_->carved)
+                    return layout::handle_of(reuse_page_, reuse_slot_);
+            }
+            reuse_page_ = reuse_ == pyramid_reuse::address_order ? next_reused_page() : densest_reused_page();
+            reuse_slot_ = detail::pyramid_next_bit<false>(reuse_page_->occupancy(), 0, reuse_page_->carved);
+            return layout::handle_of(reuse_page_, reuse_slot_);
+        }
+        
+        
+        // Page with erased nodes after the swept one by address, wraps around
+        page_type* next_reused_page() const noexcept {
+            auto const sweep = reuse_page_ == nullptr
+                ? directory_.begin()
+                : std::upper_bound(directory_.begin(), directory_.end(), reuse_page_, std::less<void const*>{});
+            for(auto it = sweep; it != directory_.end(); ++it)
+                if((*it)->size != (*it)->carved)
+                    return *it;
+            for(auto it = directory_.begin();; ++it)
+                if((*it)->size != (*it)->carved)
+                    return *it;
+        }
+        
+        
+        page_type* densest_reused_page(page_type const* excluded = nullptr) const noexcept {
+            page_type* densest = nullptr;
+            for(auto* page: directory_)
+                if(page->size != page->carved && page != excluded
+                   && (densest == nullptr || page->size * densest->capacity > densest->size * page->capacity))
+                    densest = page;
+            return densest;
+        }
+        
+        
+        // The sparsest page with items if they fit into erased nodes of other pages with items
+        page_type* evacuated_page() const noexcept {
+            page_type* sparsest = nullptr;
+            auto vacancies = size_type{0};
+            for(auto* page: directory_) {
+                if(page->size == 0)
+                    continue;
+                vacancies += page->carved - page->size;
+                if(sparsest == nullptr || page->size * sparsest->capacity < sparsest->size * page->capacity)
+                    sparsest = page;
+            }
+            if(sparsest == nullptr || vacancies - (sparsest->carved - sparsest->size) < sparsest->size)
+                return nullptr;
+            return sparsest;
+        }
+        
+        
+        // Moves item to erased node which takes place of the occupied one in insertion order
+        template<typename Relocated>
+        void relocate(handle from, handle to, Relocated& relocated) {
+            auto* const source = at(from);
+            auto* const target = at(to);
+            at(target->previous_node)->next_node = target->next_node;
+            at(target->next_node)->previous_node = target->previous_node;
+            auto* const source_item = layout::item(table_, source);
+            auto* const target_item = layout::item(table_, target);
+            allocator_traits::construct(allocator_, target_item, std::move(*source_item));
+            allocator_traits::destroy(allocator_, source_item);
+            stamp(target);
+            unstamp(source);
+            target->previous_node = source->previous_node;
+            target->next_node = source->next_node;
+            at(target->previous_node)->next_node = to;
+            at(target->next_node)->previous_node = to;
+            source->previous_node = free_list();
+            source->next_node = free_nodes_.next_node;
+            at(free_nodes_.next_node)->previous_node = from;
+            free_nodes_.next_node = from;
+            auto* page = page_of(to);
+            ++page->size;
+            page->occupy(layout::slot_of(page, to));
+            page = page_of(from);
+            --page->size;
+            page->vacate(layout::slot_of(page, from));
+            ordered_ = false;
+            relocated(source_item, target_item);
+        }
+        
+        
+        // Relinks erased nodes page by page in order of their addresses
+        void sort_free_list() noexcept {
+            auto previous = free_list();
+            for(auto* page: directory_) {
+                auto const* const words = page->occupancy();
+                for(auto slot = detail::pyramid_next_bit<false>(words, 0, page->carved); slot != page->carved;
+                    slot = detail::pyramid_next_bit<false>(words, slot + 1, page->carved)) {
+                    auto const node = layout::handle_of(page, slot);
+                    at(node)->previous_node = previous;
+                    at(previous)->next_node = node;
+                    previous = node;
+                }
+            }
+            at(previous)->next_node = free_list();
+            free_nodes_.previous_node = previous;
+        }
+        
+        
+        // Distinct occupied nodes to start chains from, the first one is the head of occupied
+        // list and the others are the first occupied ones after evenly spaced carved nodes
+        template<size_type Chains>
+        size_type chain_starts(handle (&starts)[Chains]) const noexcept {
+            if(size_ == 0)
+                return 0;
+            starts[0] = occupied_nodes_.next_node;
+            auto chains = size_type{1};
+            auto carved = size_type{0};
+            for(auto* page: directory_)
+                carved += page->carved;
+            auto directory_index = size_type{0};
+            auto page_offset = size_type{0};
+            for(auto chain = size_type{1}; chain != Chains; ++chain) {
+                auto const offset = carved / Chains * chain;
+                while(page_offset + directory_[directory_index]->carved <= offset)
+                    page_offset += directory_[directory_index++]->carved;
+                auto* page = directory_[directory_index];
+                auto const slot = detail::pyramid_next_bit<true>(page->occupancy(), offset - page_offset, page->carved);
+                if(slot == page->carved)
+                    continue;
+                auto const start = layout::handle_of(page, slot);
+                if(std::find(starts, starts + chains, start) == starts + chains)
+                    starts[chains++] = start;
+            }
+            return chains;
+        }
+        
+        
+        // Moves free node right after another node of free list
+        void relink_free_node(handle node, handle previous) noexcept {
+            auto* const relinked = at(node);
+            if(relinked->previous_node == previous)
+                return;
+            at(relinked->previous_node)->next_node = relinked->next_node;
+            at(relinked->next_node)->previous_node = relinked->previous_node;
+            relinked->previous_node = previous;
+            relinked->next_node = at(previous)->next_node;
+            at(relinked->next_node)->previous_node = node;
+            at(previous)->next_node = node;
+        }
+        
+        
+        // Generational layout gives each occupied node the next generation, zero is skipped
+        void stamp(node_type* node) noexcept {
+            if constexpr(layout::generational) {
+                if(++generation_ == 0)
+                    ++generation_;
+                node->generation = generation_;
+            }
+        }
+        
+        
+        void unstamp(node_type* node) noexcept {
+            if constexpr(layout::generational)
+                node->generation = 0;
+        }
+        
+        
+        // Doubly linked chain of destroyed nodes goes to the head of free list
+        void free_run(handle run_first, handle run_last, size_type n) noexcept {
+            at(run_first)->previous_node = free_list();
+            at(run_last)->next_node = free_nodes_.next_node;
+            at(free_nodes_.next_node)->previous_node = run_last;
+            free_nodes_.next_node = run_first;
+            size_ -= n;
+            ordered_ = false;
+            if(capacity_ - size_ > release_watermark_)
+                release_emptied_pages();
+        }
+        
+        
+        // Releases pages that became empty while capacity exceeds size by more than watermark
+        void release_emptied_pages() noexcept {
+            for(auto* page = pages_.next_page; page != &pages_ && capacity_ - size_ > release_watermark_;) {
+                auto* next_page = page->next_page;
+                if(page->size == 0 && page->carved != 0)
+                    release_page(page);
+                page = next_page;
+            }
+        }
+        
+        
+        handle free_node(handle erasable) {
+            auto* node = at(erasable);
+            auto const next_node = node->next_node;
+            auto* page = page_of(erasable);
+            allocator_traits::destroy(allocator_, item_of(page, erasable));
+            unstamp(node);
+            at(node->previous_node)->next_node = node->next_node;
+            at(node->next_node)->previous_node = node->previous_node;
+            node->previous_node = free_list();
             node->next_node = free_nodes_.next_node;
-            free_nodes_.next_node->previous_node = node;
-            free_nodes_.next_node = node;
+            at(free_nodes_.next_node)->previous_node = erasable;
+            free_nodes_.next_node = erasable;
             --size_;
+            ordered_ = false;
+            page->vacate(layout::slot_of(page, erasable));
+            if(--page->size == 0 && capacity_ - size_ > release_watermark_)
+                release_page(page);
             return next_node;
         }
+    
+    
+    }; // pyramid
+
+
+#if __has_include(<memory_resource>)
+    namespace pmr {
         
         
-    }; // pyramid
+        template<typename T,
+                 detail::pyramid_size_type F = 16,
+                 typename G = pyramid_growth::geometric<F>,
+                 typename L = pyramid_layout::interleaved>
+        using pyramid = etceteras::pyramid<T, F, G, std::pmr::polymorphic_allocator<T>, L>;
     
     
+    } // namespace pmr
+#endif
+
+
 } // namespace etceteras
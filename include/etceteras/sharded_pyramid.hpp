@@ -0,0 +1,389 @@
+// This file is part of etceteras library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "concurrent_pyramid.hpp"
+#include "pyramid.hpp"
+
+
+namespace etceteras {
+    
+    
+    // Items are striped across Shards pyramids, each behind its own lock on its own
+    // cache lines. Items go to the shard of calling thread or of the given key,
+    // so threads mostly take uncontended locks of different shards.
+    // Iterators remember their shard, erase locks only that one
+    template<typename T,
+             detail::pyramid_size_type Shards = 16,
+             typename G = pyramid_growth::geometric<16>,
+             typename A = std::allocator<T>,
+             typename L = pyramid_layout::interleaved>
+    class sharded_pyramid {
+        
+        static_assert(Shards > 0, "Sharded pyramid should have at least one shard");
+        
+        using shard_pyramid = pyramid<T, 16, G, A, L>;
+        
+        struct alignas(detail::pyramid_cache_line) shard {
+            mutable detail::pyramid_spinlock lock;
+            shard_pyramid items;
+            
+            explicit shard(A const& allocator): items{allocator} { }
+        }; // shard
+        
+        using shard_allocator = typename std::allocator_traits<A>::template rebind_alloc<shard>;
+        using shard_allocator_traits = std::allocator_traits<shard_allocator>;
+        
+        static_assert(std::is_pointer_v<typename shard_allocator_traits::pointer>,
+                      "Allocators with fancy pointers are not supported");
+        
+        shard_allocator allocator_;
+        shard* shards_;
+    
+    public:
+        
+        using size_type = detail::pyramid_size_type;
+        using value_type = T;
+        using allocator_type = A;
+        
+        static size_type constexpr shards = Shards;
+        
+        
+        class iterator {
+        friend class sharded_pyramid;
+        friend class const_iterator;
+            shard* shards_;
+            size_type shard_;
+            typename shard_pyramid::iterator it_;
+            
+            iterator(shard* shards, size_type shard, typename shard_pyramid::iterator it) noexcept
+                : shards_{shards}, shard_{shard}, it_{it} { }
+            
+            // Moves to the first item of the next non-empty shard if current one is over
+            void skip_ended() noexcept {
+                while(it_ == shards_[shard_].items.end() && shard_ + 1 != Shards) {
+                    ++shard_;
+                    it_ = shards_[shard_].items.begin();
+                }
+            }
+        
+        public:
+            
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+            
+            iterator(iterator const&) = default;
+            iterator& operator = (iterator const&) = default;
+            
+            bool operator == (iterator const& other) const noexcept {
+                return shard_ == other.shard_ && it_ == other.it_;
+            }
+            
+            bool operator != (iterator const& other) const noexcept {
+                return !(*this == other);
+            }
+            
+            T& operator * () const noexcept {
+                return *it_;
+            }
+            
+            T* operator -> () const noexcept {
+                return &*it_;
+            }
+            
+            iterator& operator ++ () noexcept {
+                ++it_;
+                skip_ended();
+                return *this;
+            }
+            
+            iterator operator ++ (int) noexcept {
+                auto const last = *this;
+                ++*this;
+                return last;
+            }
+            
+            size_type shard_index() const noexcept {
+                return shard_;
+            }
+        }; // iterator
+        
+        
+        class const_iterator {
+        friend class sharded_pyramid;
+            shard const* shards_;
+            size_type shard_;
+            typename shard_pyramid::const_iterator it_;
+            
+            const_iterator(shard const* shards, size_type shard, typename shard_pyramid::const_iterator it) noexcept
+                : shards_{shards}, shard_{shard}, it_{it} { }
+            
+            void skip_ended() noexcept {
+                while(it_ == shards_[shard_].items.end() && shard_ + 1 != Shards) {
+                    ++shard_;
+                    it_ = shards_[shard_].items.begin();
+                }
+            }
+        
+        public:
+            
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T const*;
+            using reference = T const&;
+            
+            const_iterator(const_iterator const&) = default;
+            const_iterator& operator = (const_iterator const&) = default;
+            
+            const_iterator(iterator const& other) noexcept
+                : shards_{other.shards_}, shard_{other.shard_}, it_{other.it_} { }
+            
+            bool operator == (const_iterator const& other) const noexcept {
+                return shard_ == other.shard_ && it_ == other.it_;
+            }
+            
+            bool operator != (const_iterator const& other) const noexcept {
+                return !(*this == other);
+            }
+            
+            T const& operator * () const noexcept {
+                return *it_;
+            }
+            
+            T const* operator -> () const noexcept {
+                return &*it_;
+            }
+            
+            const_iterator& operator ++ () noexcept {
+                ++it_;
+                skip_ended();
+                return *this;
+            }
+            
+            const_iterator operator ++ (int) noexcept {
+                auto const last = *this;
+                ++*this;
+                return last;
+            }
+            
+            size_type shard_index() const noexcept {
+                return shard_;
+            }
+        }; // const_iterator
+        
+        
+        sharded_pyramid(): sharded_pyramid(A()) { }
+        
+        
+        explicit sharded_pyramid(A const& allocator)
+            : allocator_{allocator}, shards_{shard_allocator_traits::allocate(allocator_, Shards)} {
+            for(auto i = size_type{0}; i != Shards; ++i)
+                shard_allocator_traits::construct(allocator_, shards_ + i, allocator);
+        }
+        
+        
+        sharded_pyramid(sharded_pyramid const&) = delete;
+        sharded_pyramid& operator = (sharded_pyramid const&) = delete;
+        
+        
+        ~sharded_pyramid() {
+            for(auto i = size_type{0}; i != Shards; ++i)
+                shard_allocator_traits::destroy(allocator_, shards_ + i);
+            shard_allocator_traits::deallocate(allocator_, shards_, Shards);
+        }
+        
+        
+        allocator_type get_allocator() const noexcept {
+            return allocator_type{allocator_};
+        }
+        
+        
+        // Sum of shard sizes taken one by one
+        size_type size() const noexcept {
+            auto size = size_type{0};
+            for(auto i = size_type{0}; i != Shards; ++i) {
+                auto const lock = std::lock_guard<detail::pyramid_spinlock>{shards_[i].lock};
+                size += shards_[i].items.size();
+            }
+            return size;
+        }
+        
+        
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+        
+        
+        // Shard of calling thread
+        size_type own_shard() const noexcept {
+            return detail::pyramid_thread_index() % Shards;
+        }
+        
+        
+        iterator insert(T const& item) {
+            return emplace_keyed(own_shard(), item);
+        }
+        
+        
+        iterator insert(T&& item) {
+            return emplace_keyed(own_shard(), std::move(item));
+        }
+        
+        
+        template<typename... Args>
+        iterator emplace(Args&&... args) {
+            return emplace_keyed(own_shard(), std::forward<Args>(args)...);
+        }
+        
+        
+        // Puts item to shard key % Shards, items of the same key share a shard
+        template<typename... Args>
+        iterator emplace_keyed(size_type key, Args&&... args) {
+            auto const index = key % Shards;
+            auto& s = shards_[index];
+            auto const lock = std::lock_guard<detail::pyramid_spinlock>{s.lock};
+            return iterator{shards_, index, s.items.emplace(std::forward<Args>(args)...)};
+        }
+        
+        
+        void erase(const_iterator it) {
+            auto& s = shards_[it.shard_];
+            auto const lock = std::lock_guard<detail::pyramid_spinlock>{s.lock};
+            s.items.erase(it.it_);
+        }
+        
+        
+        // Shards are visited in order, nothing should be inserted or erased meanwhile
+        iterator begin() noexcept {
+            auto it = iterator{shards_, 0, shards_[0].items.begin()};
+            it.skip_ended();
+            return it;
+        }
+        
+        
+        iterator end() noexcept {
+            return iterator{shards_, Shards - 1, shards_[Shards - 1].items.end()};
+        }
+        
+        
+        const_iterator begin() const noexcept {
+            auto it = const_iterator{shards_, 0, shards_[0].items.begin()};
+            it.skip_ended();
+            return it;
+        }
+        
+        
+        const_iterator end() const noexcept {
+            return const_iterator{shards_, Shards - 1, shards_[Shards - 1].items.end()};
+        }
+        
+        
+        const_iterator cbegin() const noexcept {
+            return begin();
+        }
+        
+        
+        const_iterator cend() const noexcept {
+            return end();
+        }
+        
+        
+        // Visits shards in parallel on up to threads threads including the calling one,
+        // each shard is locked while visited, so f is called concurrently for items of
+        // different shards only. The first exception thrown by f is rethrown
+        template<typename Function>
+        void for_each(Function&& f, size_type threads = std::thread::hardware_concurrency()) {
+            auto next = std::atomic<size_type>{0};
+            auto failure = std::exception_ptr{};
+            auto failure_lock = std::mutex{};
+            auto const visit = [this, &f, &next, &failure, &failure_lock] {
+                for(auto index = next++; index < Shards; index = next++) {
+                    auto& s = shards_[index];
+                    auto const lock = std::lock_guard<detail::pyramid_spinlock>{s.lock};
+                    try {
+                        s.items.for_each_unordered(f);
+                    } catch(...) {
+                        auto const lock = std::lock_guard<std::mutex>{failure_lock};
+                        if(!failure)
+                            failure = std::current_exception();
+                    }
+                }
+            };
+            auto workers = std::vector<std::thread>{};
+            auto const helpers = std::min(std::max(threads, size_type{1}), Shards) - 1;
+            workers.reserve(helpers);
+            try {
+                for(auto i = size_type{0}; i != helpers; ++i)
+                    workers.emplace_back(visit);
+            } catch(...) {
+                // Not enough threads, the rest of shards is visited by those started
+            }
+            visit();
+            for(auto& worker: workers)
+                worker.join();
+            if(failure)
+                std::rethrow_exception(failure);
+        }
+        
+        
+        template<typename Function>
+        void for_each(Function&& f, size_type threads = std::thread::hardware_concurrency()) const {
+            const_cast<sharded_pyramid&>(*this).for_each([&f](T& item) { f(std::as_const(item)); }, threads);
+        }
+        
+        
+        void clear() noexcept {
+            for(auto i = size_type{0}; i != Shards; ++i) {
+                auto const lock = std::lock_guard<detail::pyramid_spinlock>{shards_[i].lock};
+                shards_[i].items.clear();
+            }
+        }
+        
+        
+        // Direct access to a shard for single threaded code, nothing else should touch it meanwhile
+        shard_pyramid& shard_at(size_type index) noexcept {
+            return shards_[index].items;
+        }
+        
+        
+        shard_pyramid const& shard_at(size_type index) const noexcept {
+            return shards_[index].items;
+        }
+    }; // sharded_pyramid
+
+
+#if __has_include(<memory_resource>)
+    namespace pmr {
+        
+        
+        template<typename T,
+                 detail::pyramid_size_type Shards = 16,
+                 typename G = pyramid_growth::geometric<16>,
+                 typename L = pyramid_layout::interleaved>
+        using sharded_pyramid = etceteras::sharded_pyramid<T, Shards, G, std::pmr::polymorphic_allocator<T>, L>;
+    
+    
+    } // namespace pmr
+#endif
+
+
+} // namespace etceteras
@@ -0,0 +1,483 @@
+// This file is part of etceteras library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "pyramid.hpp"
+
+
+namespace etceteras {
+    
+    
+    namespace detail {
+        
+        // Node of unordered pyramid, free node keeps its link in place of destroyed item
+        template<typename T>
+        union pyramid_slot {
+            pyramid_slot() noexcept { }
+            ~pyramid_slot() { }
+            T item;
+            pyramid_slot* next_free;
+        }; // pyramid_slot
+        
+        
+        // Pages of unordered pyramid hold slots and occupancy bitmap after them
+        template<typename T>
+        struct pyramid_slot_layout {
+            using node = pyramid_slot<T>;
+            using page = pyramid_page<T, node>;
+            
+            static pyramid_size_type constexpr alignment = alignof(page);
+            static pyramid_size_type constexpr node_size = sizeof(node);
+            static pyramid_size_type constexpr page_overhead = sizeof(page) - sizeof(node);
+            static pyramid_size_type constexpr max_page_capacity = ~pyramid_size_type{0};
+            
+            static pyramid_size_type page_bytes(pyramid_size_type capacity) noexcept {
+                return page::bitmap_end(capacity);
+            }
+        }; // pyramid_slot_layout
+    
+    
+    } // namespace detail
+    
+    
+    // Pyramid without insertion order: items are visited page by page through
+    // occupancy bitmaps, erased nodes are reused last erased first
+    template<typename T,
+             detail::pyramid_size_type F = 16,
+             typename G = pyramid_growth::geometric<F>,
+             typename A = std::allocator<T>>
+    class unordered_pyramid: detail::pyramid_storage<unordered_pyramid<T, F, G, A>, detail::pyramid_slot_layout<T>, G, A> {
+        
+        using layout = detail::pyramid_slot_layout<T>;
+        using storage = detail::pyramid_storage<unordered_pyramid, layout, G, A>;
+        using node_type = typename layout::node;
+        using page_type = typename layout::page;
+        using allocator_traits = std::allocator_traits<A>;
+        
+        friend storage;
+        
+        static_assert(std::is_same_v<typename allocator_traits::value_type, T>,
+                      "Allocator should have the same value_type as unordered_pyramid");
+        
+        using storage::allocator_;
+        using storage::capacity_;
+        using storage::pages_;
+        using storage::carving_page_;
+        using storage::directory_;
+        using storage::allocate_page;
+        using storage::release_page;
+        detail::pyramid_size_type size_;
+        node_type* free_nodes_;
+        bool growth_allowed_{true};
+    
+    public:
+        
+        using size_type = detail::pyramid_size_type;
+        using value_type = T;
+        using growth_policy = G;
+        using allocator_type = A;
+        
+        static size_type constexpr factor = F;
+        
+        
+        class iterator {
+        friend class unordered_pyramid;
+        friend class const_iterator;
+            page_type* page_;
+            size_type slot_;
+            
+            iterator(page_type* page, size_type slot) noexcept: page_{page}, slot_{slot} { }
+            
+            // Stops at the first occupied node from slot on, sentinel page has no capacity
+            void seek(size_type slot) noexcept {
+                for(;;) {
+                    if(page_->capacity == 0) {
+                        slot_ = 0;
+                        return;
+                    }
+                    if(page_->size != 0) {
+                        slot_ = detail::pyramid_next_bit<true>(page_->occupancy(), slot, page_->carved);
+                        if(slot_ != page_->carved)
+                            return;
+                    }
+                    page_ = page_->next_page;
+                    slot = 0;
+                }
+            }
+        
+        public:
+            
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+            
+            iterator(iterator const&) = default;
+            iterator& operator = (iterator const&) = default;
+            
+            bool operator == (iterator const& other) const noexcept {
+                return page_ == other.page_ && slot_ == other.slot_;
+            }
+            
+            bool operator != (iterator const& other) const noexcept {
+                return !(*this == other);
+            }
+            
+            T& operator * () const noexcept {
+                return page_->nodes[slot_].item;
+            }
+            
+            T* operator -> () const noexcept {
+                return &page_->nodes[slot_].item;
+            }
+            
+            iterator& operator ++ () noexcept {
+                seek(slot_ + 1);
+                return *this;
+            }
+            
+            iterator operator ++ (int) noexcept {
+                auto const last = *this;
+                seek(slot_ + 1);
+                return last;
+            }
+        }; // iterator
+        
+        
+        class const_iterator {
+        friend class unordered_pyramid;
+            iterator it_;
+        
+        public:
+            
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T const*;
+            using reference = T const&;
+            
+            const_iterator(const_iterator const&) = default;
+            const_iterator& operator = (const_iterator const&) = default;
+            const_iterator(iterator const& it) noexcept: it_{it} { }
+            
+            bool operator == (const_iterator const& other) const noexcept {
+                return it_ == other.it_;
+            }
+            
+            bool operator != (const_iterator const& other) const noexcept {
+                return it_ != other.it_;
+            }
+            
+            T const& operator * () const noexcept {
+                return *it_;
+            }
+            
+            T const* operator -> () const noexcept {
+                return &*it_;
+            }
+            
+            const_iterator& operator ++ () noexcept {
+                ++it_;
+                return *this;
+            }
+            
+            const_iterator operator ++ (int) noexcept {
+                auto const last = *this;
+                ++it_;
+                return last;
+            }
+        }; // const_iterator
+        
+        
+        unordered_pyramid() noexcept(noexcept(A())): unordered_pyramid(A()) { }
+        
+        
+        explicit unordered_pyramid(A const& allocator) noexcept: storage{allocator} {
+            init();
+        }
+        
+        
+        ~unordered_pyramid() {
+            clear();
+        }
+        
+        
+        unordered_pyramid(unordered_pyramid const& other)
+            : unordered_pyramid(other, allocator_traits::select_on_container_copy_construction(other.allocator_)) { }
+        
+        
+        unordered_pyramid(unordered_pyramid const& other, A const& allocator): storage{allocator} {
+            init();
+            try {
+                reserve(other.size_);
+                for(auto const& item: other)
+                    emplace(item);
+            } catch(...) {
+                clear();
+                throw;
+            }
+            adopt_settings(other);
+        }
+        
+        
+        unordered_pyramid& operator = (unordered_pyramid const& other) {
+            storage::copy_assign(other);
+            return *this;
+        }
+        
+        
+        unordered_pyramid(unordered_pyramid&& other) noexcept: storage{std::move(other.allocator_)} {
+            move_from(std::move(other));
+        }
+        
+        
+        unordered_pyramid(unordered_pyramid&& other, A const& allocator): storage{allocator} {
+            storage::move_construct(std::move(other));
+        }
+        
+        
+        unordered_pyramid& operator = (unordered_pyramid&& other)
+            noexcept(allocator_traits::propagate_on_container_move_assignment::value
+                     || allocator_traits::is_always_equal::value) {
+            storage::move_assign(std::move(other));
+            return *this;
+        }
+        
+        
+        // Allocators are swapped only if they propagate on swap,
+        // otherwise they should be equal
+        void swap(unordered_pyramid& other) noexcept {
+            storage::swap_with(other);
+        }
+        
+        
+        friend void swap(unordered_pyramid& x, unordered_pyramid& y) noexcept {
+            x.swap(y);
+        }
+        
+        
+        allocator_type get_allocator() const noexcept {
+            return allocator_;
+        }
+        
+        
+        size_type size() const noexcept {
+            return size_;
+        }
+        
+        
+        size_type capacity() const noexcept {
+            return capacity_;
+        }
+        
+        
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+        
+        
+        bool growth_allowed() const noexcept {
+            return growth_allowed_;
+        }
+        
+        
+        // When growth is not allowed, insert throws std::bad_alloc instead of allocating
+        // a page if there are no free nodes. It goes along with items on copy, move and swap
+        void allow_growth(bool allowed) noexcept {
+            growth_allowed_ = allowed;
+        }
+        
+        
+        // Releases pages without occupied nodes, their free nodes are
+        // dropped from the free list first
+        void shrink_to_fit() noexcept {
+            auto** link = &free_nodes_;
+            while(*link != nullptr) {
+                if(page_of(*link)->size == 0)
+                    *link = (*link)->next_free;
+                else
+                    link = &(*link)->next_free;
+            }
+            for(auto* page = pages_.next_page; page != &pages_;) {
+                auto* next_page = page->next_page;
+                if(page->size == 0)
+                    release_page(page);
+                page = next_page;
+            }
+        }
+        
+        
+        // Allocates pages for at least n nodes regardless of allowed growth
+        void reserve(size_type n) {
+            while(capacity_ < n)
+                allocate_page(n - capacity_);
+        }
+        
+        
+        void clear() noexcept {
+            if constexpr(!detail::pyramid_trivially_destroyed<T, A>)
+                for(auto it = begin(); it != end(); ++it)
+                    allocator_traits::destroy(allocator_, &*it);
+            storage::release_pages();
+            init();
+        }
+        
+        
+        // Pages are visited in order of their allocation
+        const_iterator begin() const noexcept {
+            return const_cast<unordered_pyramid&>(*this).begin();
+        }
+        
+        
+        const_iterator end() const noexcept {
+            return const_cast<unordered_pyramid&>(*this).end();
+        }
+        
+        
+        iterator begin() noexcept {
+            auto it = iterator{pages_.next_page, 0};
+            it.seek(0);
+            return it;
+        }
+        
+        
+        iterator end() noexcept {
+            return iterator{&pages_, 0};
+        }
+        
+        
+        iterator insert(T const& item) {
+            return emplace(item);
+        }
+        
+        
+        iterator insert(T&& item) {
+            return emplace(std::move(item));
+        }
+        
+        
+        // Constructs item right in a node, if constructor throws
+        // pyramid stays as it was except for a possibly allocated page
+        template<typename... Args>
+        iterator emplace(Args&&... args) {
+            if(free_nodes_ == nullptr) {
+                auto* page = carving_page();
+                auto* node = page->nodes + page->carved;
+                allocator_traits::construct(allocator_, &node->item, std::forward<Args>(args)...);
+                return occupy(page, page->carved++);
+            }
+            auto* node = free_nodes_;
+            auto* const next_free = node->next_free;
+            try {
+                allocator_traits::construct(allocator_, &node->item, std::forward<Args>(args)...);
+            } catch(...) {
+                node->next_free = next_free;
+                throw;
+            }
+            free_nodes_ = next_free;
+            auto* page = page_of(node);
+            return occupy(page, size_type(node - page->nodes));
+        }
+        
+        
+        const_iterator erase(const_iterator it) {
+            return const_iterator{erase(it.it_)};
+        }
+        
+        
+        iterator erase(iterator it) {
+            auto* page = it.page_;
+            auto* node = page->nodes + it.slot_;
+            allocator_traits::destroy(allocator_, &node->item);
+            node->next_free = free_nodes_;
+            free_nodes_ = node;
+            page->vacate(it.slot_);
+            --page->size;
+            --size_;
+            it.seek(it.slot_ + 1);
+            return it;
+        }
+    
+    
+    private:
+        
+        void init() {
+            storage::init_pages();
+            size_ = 0;
+            free_nodes_ = nullptr;
+        }
+        
+        
+        // Also serves move constructors, sentinel page is set up by taking pages
+        void move_from(unordered_pyramid&& other) {
+            adopt_settings(other);
+            storage::take_pages(other);
+            size_ = other.size_;
+            free_nodes_ = other.free_nodes_;
+            other.init();
+        }
+        
+        
+        // Taken after items, so that copies are not stopped by disallowed growth
+        void adopt_settings(unordered_pyramid const& other) noexcept {
+            growth_allowed_ = other.growth_allowed_;
+        }
+        
+        
+        // Page to carve a never used node from
+        page_type* carving_page() {
+            if(capacity_ == size_) {
+                if(!growth_allowed_)
+                    throw std::bad_alloc{};
+                allocate_page(~size_type{0});
+            }
+            auto* page = carving_page_;
+            while(page->carved == page->capacity)
+                page = page->next_page;
+            carving_page_ = page;
+            return page;
+        }
+        
+        
+        iterator occupy(page_type* page, size_type slot) noexcept {
+            page->occupy(slot);
+            ++page->size;
+            ++size_;
+            return iterator{page, slot};
+        }
+        
+        
+        page_type* page_of(node_type const* node) const noexcept {
+            return directory_.page_of(node);
+        }
+    
+    
+    }; // unordered_pyramid
+
+
+#if __has_include(<memory_resource>)
+    namespace pmr {
+        
+        
+        template<typename T,
+                 detail::pyramid_size_type F = 16,
+                 typename G = pyramid_growth::geometric<F>>
+        using unordered_pyramid = etceteras::unordered_pyramid<T, F, G, std::pmr::polymorphic_allocator<T>>;
+    
+    
+    } // namespace pmr
+#endif
+
+
+} // namespace etceteras
@@ -0,0 +1,147 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <etceteras/concurrent_pyramid.hpp>
+
+
+namespace {
+    
+    
+    template<typename P>
+    std::vector<typename P::value_type> sorted_concurrent_items_of(P const& pyramid) {
+        auto items = std::vector<typename P::value_type>{};
+        pyramid.for_each([&items](auto const& item) { items.push_back(item); });
+        std::sort(items.begin(), items.end());
+        return items;
+    }
+    
+    
+    struct counted_item {
+        static inline std::atomic<int> alive{0};
+        int value;
+        
+        explicit counted_item(int v): value{v} {
+            if(v < 0)
+                throw std::runtime_error{"negative"};
+            ++alive;
+        }
+        
+        ~counted_item() { --alive; }
+    }; // counted_item
+
+
+} // namespace
+
+
+TEST_SUITE("concurrent_pyramid") {
+    
+    
+    SCENARIO("concurrent insert and erase by one thread") {
+        using page = etceteras::concurrent_pyramid<int, 4, 1024>;
+        REQUIRE_GT(page::page_capacity, 20);
+        auto target = page{};
+        REQUIRE(target.empty());
+        auto addresses = std::vector<int*>{};
+        for(auto i = 0; i != 500; ++i)
+            addresses.push_back(target.insert(i));
+        REQUIRE_EQ(target.size(), 500);
+        REQUIRE_GE(target.capacity(), 500);
+        for(auto i = 0; i != 500; ++i)
+            REQUIRE_EQ(*addresses[i], i);
+        
+        auto expected = std::vector<int>{};
+        for(auto i = 0; i != 500; ++i)
+            if(i % 3 == 0)
+                target.erase(addresses[i]);
+            else
+                expected.push_back(i);
+        REQUIRE_EQ(target.size(), expected.size());
+        REQUIRE_EQ(sorted_concurrent_items_of(target), expected);
+        
+        auto const capacity = target.capacity();
+        for(auto i = 1000; i != 1000 + 500 / 3; ++i) {
+            target.insert(i);
+            expected.push_back(i);
+        }
+        REQUIRE_EQ(target.capacity(), capacity);
+        REQUIRE_EQ(sorted_concurrent_items_of(target), expected);
+        
+        target.clear();
+        REQUIRE(target.empty());
+        REQUIRE_EQ(target.capacity(), 0);
+        REQUIRE_EQ(sorted_concurrent_items_of(target), std::vector<int>{});
+    }
+    
+    
+    SCENARIO("concurrent insert and erase by many threads") {
+        auto target = etceteras::concurrent_pyramid<std::uint64_t, 8, 4096>{};
+        auto constexpr threads = 4;
+        auto constexpr items = 4000;
+        auto kept = std::vector<std::vector<std::uint64_t*>>(threads);
+        auto workers = std::vector<std::thread>{};
+        for(auto t = 0; t != threads; ++t)
+            workers.emplace_back([&target, &kept, t] {
+                auto own = std::vector<std::uint64_t*>{};
+                for(auto i = 0; i != items; ++i) {
+                    own.push_back(target.insert(std::uint64_t(t) * items + i));
+                    if(i % 4 == 3) {
+                        target.erase(own[own.size() - 2]);
+                        own.erase(own.end() - 2);
+                    }
+                }
+                kept[t] = std::move(own);
+            });
+        for(auto& worker: workers)
+            worker.join();
+        
+        auto expected = std::vector<std::uint64_t>{};
+        for(auto const& own: kept)
+            for(auto* item: own)
+                expected.push_back(*item);
+        std::sort(expected.begin(), expected.end());
+        REQUIRE_EQ(target.size(), expected.size());
+        REQUIRE_EQ(sorted_concurrent_items_of(target), expected);
+        
+        // Every thread erases items inserted by the next one
+        workers.clear();
+        for(auto t = 0; t != threads; ++t)
+            workers.emplace_back([&target, &kept, t] {
+                for(auto* item: kept[(t + 1) % threads])
+                    target.erase(item);
+            });
+        for(auto& worker: workers)
+            worker.join();
+        REQUIRE(target.empty());
+        REQUIRE_EQ(sorted_concurrent_items_of(target), std::vector<std::uint64_t>{});
+    }
+    
+    
+    SCENARIO("concurrent emplace with throwing constructor") {
+        {
+            auto target = etceteras::concurrent_pyramid<counted_item, 2, 1024>{};
+            auto* first = target.emplace(1);
+            REQUIRE_THROWS_AS(target.emplace(-1), std::runtime_error);
+            REQUIRE_EQ(target.size(), 1);
+            auto* second = target.emplace(2);
+            REQUIRE_NE(first, second);
+            REQUIRE_EQ(counted_item::alive, 2);
+            target.erase(first);
+            REQUIRE_EQ(counted_item::alive, 1);
+            auto values = std::vector<int>{};
+            target.for_each([&values](counted_item const& item) { values.push_back(item.value); });
+            REQUIRE_EQ(values, std::vector<int>{2});
+        }
+        REQUIRE_EQ(counted_item::alive, 0);
+    }
+
+
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <etceteras/epoch_pyramid.hpp>
+
+
+namespace {
+    
+    
+    // Poisoned by destructor, so readers notice items destroyed under them
+    struct checked_item {
+        static inline std::atomic<int> alive{0};
+        std::uint64_t value;
+        std::uint64_t check;
+        
+        explicit checked_item(std::uint64_t v) noexcept: value{v}, check{~v} { ++alive; }
+        
+        ~checked_item() {
+            check = value;
+            --alive;
+        }
+        
+        bool intact() const noexcept {
+            return check == ~value;
+        }
+    }; // checked_item
+
+
+} // namespace
+
+
+TEST_SUITE("epoch_pyramid") {
+    
+    
+    SCENARIO("epoch insert and erase") {
+        auto target = etceteras::epoch_pyramid<int>{};
+        REQUIRE(target.empty());
+        REQUIRE(target.begin() == target.end());
+        auto iterators = std::vector<etceteras::epoch_pyramid<int>::iterator>{};
+        for(auto i = 0; i != 10; ++i)
+            iterators.push_back(target.insert(i));
+        REQUIRE_EQ(target.size(), 10);
+        REQUIRE_EQ(std::vector<int>(target.begin(), target.end()), std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+        
+        REQUIRE_EQ(*target.erase(iterators[3]), 4);
+        REQUIRE(target.erase(iterators[9]) == target.end());
+        target.erase(iterators[0]);
+        REQUIRE_EQ(target.size(), 7);
+        REQUIRE_EQ(target.retired(), 3);
+        REQUIRE_EQ(std::vector<int>(target.begin(), target.end()), std::vector<int>{1, 2, 4, 5, 6, 7, 8});
+        
+        // Without readers erased nodes are reused right away
+        REQUIRE_EQ(target.reclaim(), 3);
+        auto const capacity = target.capacity();
+        target.insert(10);
+        target.insert(11);
+        target.insert(12);
+        REQUIRE_EQ(target.capacity(), capacity);
+        auto const reader = target.read();
+        REQUIRE_EQ(std::vector<int>(reader.begin(), reader.end()), std::vector<int>{1, 2, 4, 5, 6, 7, 8, 10, 11, 12});
+    }
+    
+    
+    SCENARIO("epoch erased items outlive readers") {
+        {
+            auto target = etceteras::epoch_pyramid<checked_item>{};
+            for(auto i = 0u; i != 8; ++i)
+                target.emplace(i);
+            auto first = target.read();
+            auto it = first.begin();
+            ++it;
+            REQUIRE_EQ(it->value, 1u);
+            
+            // Reader standing on erased item goes on to the rest
+            target.erase(std::next(target.begin()));
+            target.erase(std::next(target.begin()));
+            REQUIRE_EQ(target.reclaim(), 0);
+            REQUIRE_EQ(checked_item::alive, 8);
+            REQUIRE(it->intact());
+            ++it;
+            REQUIRE_EQ(it->value, 2u);
+            ++it;
+            REQUIRE_EQ(it->value, 3u);
+            
+            // Later reader does not hold back what was erased before it came
+            {
+                auto const second = target.read();
+                target.erase(target.begin());
+                REQUIRE_EQ(target.reclaim(), 0);
+                {
+                    auto const moved = std::move(first);
+                }
+                REQUIRE_EQ(target.reclaim(), 2);
+                REQUIRE_EQ(checked_item::alive, 6);
+                auto values = std::vector<std::uint64_t>{};
+                second.for_each([&values](checked_item const& item) { values.push_back(item.value); });
+                REQUIRE_EQ(values, std::vector<std::uint64_t>{3, 4, 5, 6, 7});
+            }
+            REQUIRE_EQ(target.reclaim(), 1);
+            REQUIRE_EQ(checked_item::alive, 5);
+            target.clear();
+            REQUIRE(target.empty());
+            REQUIRE_EQ(checked_item::alive, 0);
+            target.emplace(100u);
+        }
+        REQUIRE_EQ(checked_item::alive, 0);
+    }
+    
+    
+    SCENARIO("epoch readers scan while writer mutates") {
+        auto target = etceteras::epoch_pyramid<checked_item, 8>{};
+        auto live = std::vector<etceteras::epoch_pyramid<checked_item, 8>::iterator>{};
+        for(auto i = 0u; i != 1000; ++i)
+            live.push_back(target.emplace(i));
+        auto stop = std::atomic<bool>{false};
+        auto damaged = std::atomic<int>{0};
+        auto scans = std::atomic<int>{0};
+        auto readers = std::vector<std::thread>{};
+        for(auto r = 0; r != 3; ++r)
+            readers.emplace_back([&] {
+                while(!stop.load()) {
+                    auto const reader = target.read();
+                    auto previous = std::uint64_t{0};
+                    for(auto const& item: reader) {
+                        // Items are inserted with growing values and never change
+                        if(!item.intact() || item.value < previous)
+                            ++damaged;
+                        previous = item.value;
+                    }
+                    ++scans;
+                }
+            });
+        auto next = std::uint64_t{1000};
+        auto seed = std::uint64_t{0x9E3779B97F4A7C15ull};
+        for(auto i = 0; i < 20000 || scans.load() < 10; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            auto const victim = seed % live.size();
+            target.erase(live[victim]);
+            live[victim] = live.back();
+            live.pop_back();
+            live.push_back(target.emplace(next++));
+        }
+        stop = true;
+        for(auto& reader: readers)
+            reader.join();
+        REQUIRE_EQ(damaged.load(), 0);
+        REQUIRE_EQ(target.size(), 1000);
+        target.reclaim();
+        REQUIRE_EQ(target.retired(), 0);
+    }
+
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <etceteras/huge_pages.hpp>
+
+
+TEST_SUITE("huge_pages") {
+
+
+    SCENARIO("allocate aligned huge pages") {
+        auto allocator = etceteras::huge_page_allocator<int>{};
+        auto* allocated = allocator.allocate(1000);
+#if defined(__linux__)
+        REQUIRE_EQ(reinterpret_cast<std::uintptr_t>(allocated) % etceteras::huge_page_size, 0);
+#endif
+        allocated[0] = 1;
+        allocated[999] = 2;
+        allocator.deallocate(allocated, 1000);
+    }
+    
+    
+    SCENARIO("fall back from reserved huge pages") {
+        auto allocator = etceteras::huge_page_allocator<char>{
+            etceteras::huge_page_mode::reserved, 0, true};
+        auto* allocated = allocator.allocate(etceteras::huge_page_size + 1);
+        REQUIRE_NE(allocated, nullptr);
+        allocated[etceteras::huge_page_size] = 1;
+        allocator.deallocate(allocated, etceteras::huge_page_size + 1);
+    }
+    
+    
+    SCENARIO("pyramid with huge pages") {
+        auto target = etceteras::huge_page_pyramid<int>{};
+        target.insert(1);
+        auto const node_size = sizeof(etceteras::detail::pyramid_node<int>);
+        auto const page_overhead = sizeof(etceteras::detail::pyramid_page<int>) - node_size;
+        auto const context = etceteras::pyramid_growth::context{0, 0, node_size, page_overhead};
+        REQUIRE_EQ(target.capacity(), etceteras::pyramid_growth::page_nodes(context, etceteras::huge_page_size));
+        REQUIRE_LE(etceteras::pyramid_growth::page_bytes(context, target.capacity()), etceteras::huge_page_size);
+        for(auto i = 0; i != 100000; ++i)
+            target.insert(i);
+        REQUIRE_EQ(target.size(), 100001);
+    }
+    
+    
+#if defined(__linux__)
+    SCENARIO("prefault pages up to the last byte") {
+        using allocator = etceteras::huge_page_allocator<int>;
+        using growth = etceteras::pyramid_growth::fixed<20000>;
+        using split_pyramid = etceteras::pyramid<int, 16, growth, allocator, etceteras::pyramid_layout::split>;
+        auto const os_page = std::uintptr_t(::sysconf(_SC_PAGESIZE));
+        // Never used items start at various offsets within an OS page,
+        // nothing but prefault touches the end of items array
+        for(auto filled = 1; filled < 1100; filled += 7) {
+            auto target = split_pyramid{allocator{etceteras::huge_page_mode::none}};
+            for(auto i = 0; i != filled; ++i)
+                target.insert(i);
+            target.reserve(target.capacity(), true);
+            auto* const items = &*target.begin();
+            auto const first = reinterpret_cast<std::uintptr_t>(items + filled) / os_page * os_page;
+            auto const last = reinterpret_cast<std::uintptr_t>(items + target.capacity());
+            auto resident = std::vector<unsigned char>((last - first + os_page - 1) / os_page);
+            REQUIRE_EQ(::mincore(reinterpret_cast<void*>(first), last - first, resident.data()), 0);
+            auto missing = 0;
+            for(auto const page: resident)
+                missing += (page & 1) == 0;
+            REQUIRE_EQ(missing, 0);
+        }
+    }
+#endif
+
+
+}
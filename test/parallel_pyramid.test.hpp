@@ -0,0 +1,129 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <etceteras/parallel_pyramid.hpp>
+
+
+namespace {
+    
+    
+    // Runs tasks later on its own threads, as thread pools do
+    class deferred_executor {
+        std::vector<std::function<void()>>* tasks_;
+    
+    public:
+        explicit deferred_executor(std::vector<std::function<void()>>& tasks) noexcept: tasks_{&tasks} { }
+        
+        void operator () (std::function<void()> task) {
+            tasks_->push_back(std::move(task));
+        }
+    }; // deferred_executor
+
+
+} // namespace
+
+
+TEST_SUITE("parallel_pyramid") {
+    
+    
+    SCENARIO("chunks of pages") {
+        using growth = etceteras::pyramid_growth::fixed<300>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        for(auto i = 0; i != 1000; ++i)
+            target.insert(i);
+        target.erase_if([](int item) { return item % 3 == 0 || (item >= 300 && item < 600); });
+        auto chunks = std::vector<std::vector<int>>{};
+        target.for_each_chunk(100, [&chunks](auto chunk) {
+            chunks.emplace_back();
+            chunk.for_each([&chunks](int item) { chunks.back().push_back(item); });
+        });
+        // Grain is rounded up to whole words, the empty page is skipped
+        auto const grain = std::size_t(100 + etceteras::detail::pyramid_word_bits - 1)
+            / etceteras::detail::pyramid_word_bits * etceteras::detail::pyramid_word_bits;
+        auto const per_page = (300 + grain - 1) / grain;
+        REQUIRE_EQ(chunks.size(), 2 * per_page + (100 + grain - 1) / grain);
+        auto visited = std::vector<int>{};
+        for(auto const& chunk: chunks)
+            visited.insert(visited.end(), chunk.begin(), chunk.end());
+        std::sort(visited.begin(), visited.end());
+        auto expected = std::vector<int>{};
+        target.for_each_unordered([&expected](int item) { expected.push_back(item); });
+        std::sort(expected.begin(), expected.end());
+        REQUIRE_EQ(visited, expected);
+    }
+    
+    
+    SCENARIO("parallel for each on threads") {
+        auto target = etceteras::pyramid<int>{};
+        for(auto i = 0; i != 100000; ++i)
+            target.insert(i);
+        target.erase_if([](int item) { return item % 7 == 0; });
+        auto expected = 0ll;
+        for(auto item: target)
+            expected += item;
+        
+        auto sum = std::atomic<long long>{0};
+        etceteras::parallel_for_each(target, [&sum](int& item) { sum += item; ++item; });
+        REQUIRE_EQ(sum.load(), expected);
+        
+        sum = 0;
+        etceteras::parallel_for_each(std::as_const(target), [&sum](int const& item) { sum += item; });
+        REQUIRE_EQ(sum.load(), expected + (long long)target.size());
+    }
+    
+    
+    SCENARIO("parallel for each with executor") {
+        auto target = etceteras::pyramid<int>{};
+        for(auto i = 0; i != 20000; ++i)
+            target.insert(i);
+        auto sum = std::atomic<long long>{0};
+        auto threads = std::vector<std::thread>{};
+        auto executor = [&threads](auto task) { threads.emplace_back(std::move(task)); };
+        etceteras::parallel_for_each(target, [&sum](int item) { sum += item; }, executor, 1000, 4);
+        REQUIRE_EQ(threads.size(), 3);
+        for(auto& thread: threads)
+            thread.join();
+        REQUIRE_EQ(sum.load(), 20000ll * 19999 / 2);
+        
+        // Tasks that never run leave all chunks to the caller
+        auto tasks = std::vector<std::function<void()>>{};
+        sum = 0;
+        etceteras::parallel_for_each(target, [&sum](int item) { sum += item; }, deferred_executor{tasks}, 1000, 4);
+        REQUIRE_EQ(sum.load(), 20000ll * 19999 / 2);
+        REQUIRE_EQ(tasks.size(), 3);
+        for(auto& task: tasks)
+            task();
+        REQUIRE_EQ(sum.load(), 20000ll * 19999 / 2);
+        
+        REQUIRE_THROWS_AS(etceteras::parallel_for_each(target, [](int item) {
+                              if(item == 12345)
+                                  throw std::runtime_error{"unlucky"};
+                          }, etceteras::detail::parallel_threads{}, 1000, 4),
+                          std::runtime_error);
+    }
+
+
+#if defined(__cpp_lib_execution)
+    SCENARIO("parallel for each with execution policy") {
+        auto target = etceteras::pyramid<int>{};
+        for(auto i = 0; i != 20000; ++i)
+            target.insert(i);
+        auto sum = std::atomic<long long>{0};
+        // Parallel policies may need a backend library to link, e.g. TBB for libstdc++
+        etceteras::parallel_for_each(target, [&sum](int item) { sum += item; }, std::execution::seq);
+        REQUIRE_EQ(sum.load(), 20000ll * 19999 / 2);
+    }
+#endif
+
+
+}
@@ -3,9 +3,97 @@
 
 #include "doctest.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <etceteras/pyramid.hpp>
 
 
+namespace {
+
+
+    // Stateful allocator that counts live bytes and does not propagate
+    template<typename T>
+    struct counting_allocator {
+        using value_type = T;
+        
+        int id;
+        std::size_t* live_bytes;
+        
+        counting_allocator(int id, std::size_t* live_bytes) noexcept: id{id}, live_bytes{live_bytes} { }
+        
+        template<typename U>
+        counting_allocator(counting_allocator<U> const& other) noexcept
+            : id{other.id}, live_bytes{other.live_bytes} { }
+        
+        T* allocate(std::size_t n) {
+            *live_bytes += n * sizeof(T);
+            return std::allocator<T>{}.allocate(n);
+        }
+        
+        void deallocate(T* p, std::size_t n) noexcept {
+            *live_bytes -= n * sizeof(T);
+            std::allocator<T>{}.deallocate(p, n);
+        }
+        
+        template<typename U>
+        bool operator == (counting_allocator<U> const& other) const noexcept {
+            return id == other.id;
+        }
+        
+        template<typename U>
+        bool operator != (counting_allocator<U> const& other) const noexcept {
+            return id != other.id;
+        }
+    }; // counting_allocator
+    
+    
+    // Forward iterator over pointers that throws on increment once steps run out
+    struct throwing_iterator {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int*;
+        using difference_type = std::ptrdiff_t;
+        using pointer = int* const*;
+        using reference = int* const&;
+        
+        int* const* position;
+        int* steps;
+        
+        reference operator * () const { return *position; }
+        
+        throwing_iterator& operator ++ () {
+            if(*steps == 0)
+                throw -1;
+            --*steps;
+            ++position;
+            return *this;
+        }
+        
+        bool operator == (throwing_iterator const& other) const { return position == other.position; }
+        bool operator != (throwing_iterator const& other) const { return position != other.position; }
+    }; // throwing_iterator
+    
+    
+    template<class P>
+    std::vector<typename P::value_type> items_of(P const& target) {
+        auto items = std::vector<typename P::value_type>{};
+        for(auto const& item: target)
+            items.push_back(item);
+        return items;
+    }
+    
+    
+} // namespace
+
+
 TEST_SUITE("pyramid") {
     
     
@@ -113,6 +201,1061 @@ TEST_SUITE("pyramid") {
         --it;
         REQUIRE_EQ(*it, factor + 1);
     }
+    
+    
+    SCENARIO("carve nodes sequentially and reuse erased ones first") {
+        auto target = etceteras::pyramid<int>{};
+        auto const node_size = sizeof(etceteras::detail::pyramid_node<int>);
+        auto* first = reinterpret_cast<char*>(&*target.insert(1));
+        auto* second = reinterpret_cast<char*>(&*target.insert(2));
+        REQUIRE_EQ(std::size_t(second - first), node_size);
+        target.erase(target.begin());
+        REQUIRE_EQ(reinterpret_cast<char*>(&*target.insert(3)), first);
+        auto* carved = reinterpret_cast<char*>(&*target.insert(4));
+        REQUIRE_EQ(std::size_t(carved - second), node_size);
+    }
+    
+    
+    SCENARIO("reserve") {
+        auto target = etceteras::pyramid<int>{};
+        target.reserve(1000, true);
+        auto const capacity = target.capacity();
+        REQUIRE_GE(capacity, 1000);
+        REQUIRE_LT(capacity, 2000);
+        for(auto i = 0; i != 1000; ++i)
+            target.insert(i);
+        REQUIRE_EQ(target.capacity(), capacity);
+        auto expected = 0;
+        for(auto const item: target)
+            REQUIRE_EQ(item, expected++);
+        target.reserve(10);
+        REQUIRE_EQ(target.capacity(), capacity);
+    }
+    
+    
+    SCENARIO("prefault pages in use") {
+        using growth = etceteras::pyramid_growth::fixed<1000>;
+        // Prefault of some of these pages reaches their occupancy bitmaps
+        for(auto filled = 600; filled != 1000; ++filled) {
+            auto target = etceteras::pyramid<int, 16, growth>{};
+            for(auto i = 0; i != filled; ++i)
+                target.insert(i);
+            target.erase(target.begin());
+            target.reserve(3000, true);
+            auto visited = std::vector<int>{};
+            target.for_each_run([&](etceteras::strided_span<int> run) {
+                REQUIRE_FALSE(run.empty());
+                for(auto i = std::size_t{0}; i != run.size(); ++i)
+                    visited.push_back(run[i]);
+            });
+            REQUIRE_EQ(visited, items_of(target));
+        }
+    }
+    
+    
+    SCENARIO("move after reserve") {
+        using pyramid = etceteras::pyramid<int>;
+        // Moved into dirty storage, so nothing is left from the previous object
+        alignas(pyramid) unsigned char storage[sizeof(pyramid)];
+        auto source = pyramid{};
+        source.reserve(100);
+        std::iota(std::begin(storage), std::end(storage), static_cast<unsigned char>(1));
+        auto* target = new(storage) pyramid{std::move(source)};
+        auto const capacity = target->capacity();
+        REQUIRE_GE(capacity, 100);
+        for(auto i = 0; i != 100; ++i)
+            target->insert(i);
+        REQUIRE_EQ(target->capacity(), capacity);
+        REQUIRE_EQ(*--target->end(), 99);
+        target->~pyramid();
+        
+        source.reserve(10);
+        std::iota(std::begin(storage), std::end(storage), static_cast<unsigned char>(1));
+        target = new(storage) pyramid{std::move(source), std::allocator<int>{}};
+        target->insert_n(20, 1);
+        REQUIRE_EQ(target->size(), 20);
+        target->~pyramid();
+    }
+    
+    
+    SCENARIO("insert without growth") {
+        auto target = etceteras::pyramid<int>{};
+        target.reserve(2);
+        target.allow_growth(false);
+        REQUIRE(!target.growth_allowed());
+        while(target.size() != target.capacity())
+            target.insert(0);
+        REQUIRE_THROWS_AS(target.insert(1), std::bad_alloc);
+        REQUIRE_EQ(target.size(), target.capacity());
+        target.erase(target.begin());
+        target.insert(1);
+        REQUIRE_EQ(*--target.end(), 1);
+        auto const capacity = target.capacity();
+        target.allow_growth(true);
+        target.insert(2);
+        REQUIRE_GT(target.capacity(), capacity);
+    }
+    
+    
+    SCENARIO("settings go along with items") {
+        auto source = etceteras::pyramid<int>{};
+        source.reserve(2);
+        source.allow_growth(false);
+        source.release_watermark(5);
+        source.reuse_policy(etceteras::pyramid_reuse::address_order);
+        source.insert(1);
+        auto const copy = source;
+        REQUIRE(!copy.growth_allowed());
+        REQUIRE_EQ(copy.release_watermark(), 5);
+        REQUIRE_EQ(copy.reuse_policy(), etceteras::pyramid_reuse::address_order);
+        
+        auto target = std::move(source);
+        REQUIRE(!target.growth_allowed());
+        REQUIRE_EQ(target.release_watermark(), 5);
+        REQUIRE_EQ(target.reuse_policy(), etceteras::pyramid_reuse::address_order);
+        while(target.size() != target.capacity())
+            target.insert(0);
+        REQUIRE_THROWS_AS(target.insert(2), std::bad_alloc);
+        
+        auto other = etceteras::pyramid<int>{};
+        other.swap(target);
+        REQUIRE(!other.growth_allowed());
+        REQUIRE(target.growth_allowed());
+        REQUIRE_EQ(target.reuse_policy(), etceteras::pyramid_reuse::lifo);
+        target = other;
+        REQUIRE(!target.growth_allowed());
+    }
+    
+    
+    SCENARIO("pages from allocator") {
+        using allocator = counting_allocator<int>;
+        auto live_bytes = std::size_t{0};
+        {
+            auto target = etceteras::pyramid<int, 16, etceteras::pyramid_growth::geometric<16>, allocator>{
+                allocator{1, &live_bytes}};
+            for(auto i = 0; i != 100; ++i)
+                target.insert(i);
+            REQUIRE_GE(live_bytes, target.capacity() * sizeof(etceteras::detail::pyramid_node<int>));
+            REQUIRE_EQ(target.get_allocator().id, 1);
+        }
+        REQUIRE_EQ(live_bytes, 0);
+    }
+    
+    
+    SCENARIO("only pages from allocator") {
+        using allocator = counting_allocator<int>;
+        using growth = etceteras::pyramid_growth::fixed<16>;
+        auto live_bytes = std::size_t{0};
+        auto target = etceteras::pyramid<int, 16, growth, allocator>{allocator{1, &live_bytes}};
+        target.insert(0);
+        auto const page_bytes = live_bytes;
+        // Directory of pages grows elsewhere
+        for(auto i = 1; i != 16 * 40; ++i)
+            target.insert(i);
+        REQUIRE_EQ(live_bytes, 40 * page_bytes);
+        
+        // So does page table of compact layout
+        using compact_layout = etceteras::pyramid_layout::compact;
+        using compact_traits = etceteras::detail::pyramid_layout_traits<int, compact_layout>;
+        auto compact_bytes = std::size_t{0};
+        auto compact = etceteras::pyramid<int, 16, growth, allocator, compact_layout>{allocator{2, &compact_bytes}};
+        compact.insert(0);
+        REQUIRE_LT(compact_bytes, compact_traits::table_size * sizeof(void*));
+    }
+    
+    
+    SCENARIO("move between unequal allocators") {
+        using allocator = counting_allocator<int>;
+        using pyramid = etceteras::pyramid<int, 16, etceteras::pyramid_growth::geometric<16>, allocator>;
+        auto first_bytes = std::size_t{0};
+        auto second_bytes = std::size_t{0};
+        auto source = pyramid{allocator{1, &first_bytes}};
+        source.insert(1);
+        source.insert(2);
+        auto target = pyramid{allocator{2, &second_bytes}};
+        target = std::move(source);
+        REQUIRE_EQ(target.get_allocator().id, 2);
+        REQUIRE_EQ(target.size(), 2);
+        REQUIRE_EQ(*target.begin(), 1);
+        REQUIRE(source.empty());
+        REQUIRE_EQ(first_bytes, 0);
+        REQUIRE_GT(second_bytes, 0);
+        auto const copy = pyramid{target, allocator{1, &first_bytes}};
+        REQUIRE_EQ(copy.size(), 2);
+        REQUIRE_GT(first_bytes, 0);
+    }
+    
+    
+    SCENARIO("swap") {
+        auto first = etceteras::pyramid<int>{};
+        first.insert(1);
+        auto second = etceteras::pyramid<int>{};
+        second.insert(2);
+        second.insert(3);
+        swap(first, second);
+        REQUIRE_EQ(first.size(), 2);
+        REQUIRE_EQ(*first.begin(), 2);
+        REQUIRE_EQ(*--first.end(), 3);
+        REQUIRE_EQ(second.size(), 1);
+        REQUIRE_EQ(*second.begin(), 1);
+        first.insert(4);
+        REQUIRE_EQ(*--first.end(), 4);
+    }
+    
+    
+#if __has_include(<memory_resource>)
+    SCENARIO("pages from memory resource") {
+        char buffer[4096];
+        auto upstream = std::pmr::monotonic_buffer_resource{buffer, sizeof(buffer), std::pmr::null_memory_resource()};
+        auto target = etceteras::pmr::pyramid<std::pmr::string>{&upstream};
+        auto it = target.insert(std::pmr::string{"propagated to elements"});
+        REQUIRE_EQ(it->get_allocator().resource(), &upstream);
+        auto* address = reinterpret_cast<char*>(&*it);
+        REQUIRE(address >= buffer);
+        REQUIRE(address < buffer + sizeof(buffer));
+    }
+#endif
+    
+    
+    SCENARIO("shrink to fit") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        for(auto i = 0; i != 12; ++i)
+            target.insert(i);
+        target.reserve(20);
+        REQUIRE_EQ(target.capacity(), 20);
+        auto it = target.begin();
+        for(auto i = 0; i != 4; ++i)
+            ++it;
+        for(auto i = 0; i != 4; ++i)
+            it = target.erase(it);
+        target.erase(target.begin());
+        target.shrink_to_fit();
+        REQUIRE_EQ(target.capacity(), 8);
+        REQUIRE_EQ(target.size(), 7);
+        auto expected = std::vector<int>{1, 2, 3, 8, 9, 10, 11};
+        REQUIRE_EQ(items_of(target), expected);
+        for(auto i = 12; i != 20; ++i)
+            target.insert(i);
+        REQUIRE_EQ(target.capacity(), 16);
+        for(auto i = 12; i != 20; ++i)
+            expected.push_back(i);
+        REQUIRE_EQ(items_of(target), expected);
+    }
+    
+    
+    SCENARIO("release emptied pages above watermark") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        target.release_watermark(3);
+        for(auto i = 0; i != 12; ++i)
+            target.insert(i);
+        for(auto i = 0; i != 4; ++i)
+            target.erase(target.begin());
+        REQUIRE_EQ(target.capacity(), 8);
+        for(auto i = 0; i != 4; ++i)
+            target.erase(target.begin());
+        REQUIRE_EQ(target.capacity(), 4);
+        REQUIRE_EQ(*target.begin(), 8);
+        target.insert(12);
+        REQUIRE_EQ(target.capacity(), 8);
+        
+        auto ring = etceteras::pyramid<int, 16, growth>{};
+        ring.release_watermark(0);
+        for(auto i = 0; i != 16; ++i)
+            ring.insert(i);
+        for(auto const i: {12, 13, 14, 15, 4, 5, 6, 7}) {
+            ring.erase(std::find(ring.begin(), ring.end(), i));
+            if(i == 15)
+                REQUIRE_EQ(ring.capacity(), 12);
+        }
+        REQUIRE_EQ(ring.capacity(), 8);
+        for(auto i = 16; i != 24; ++i)
+            ring.insert(i);
+        REQUIRE_EQ(ring.capacity(), 16);
+        REQUIRE_EQ(items_of(ring), std::vector<int>{0, 1, 2, 3, 8, 9, 10, 11, 16, 17, 18, 19, 20, 21, 22, 23});
+        auto unordered = std::vector<int>{};
+        ring.for_each_unordered([&](int item) { unordered.push_back(item); });
+        std::sort(unordered.begin(), unordered.end());
+        REQUIRE_EQ(unordered, items_of(ring));
+    }
+    
+    
+    SCENARIO("reuse erased nodes in order of addresses") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        target.reuse_policy(etceteras::pyramid_reuse::address_order);
+        auto addresses = std::vector<int*>{};
+        for(auto i = 0; i != 12; ++i)
+            addresses.push_back(&*target.insert(i));
+        for(auto const i: {9, 1, 6, 10})
+            target.erase(std::find(target.begin(), target.end(), i));
+        auto erased = std::vector<int*>{addresses[9], addresses[1], addresses[6], addresses[10]};
+        std::sort(erased.begin(), erased.end(), std::less<int*>{});
+        REQUIRE_EQ(&*target.insert(12), erased[0]);
+        REQUIRE_EQ(&*target.insert(13), erased[1]);
+        auto const inserted = target.insert_n(2, 14);
+        REQUIRE_EQ(&*inserted, erased[2]);
+        REQUIRE_EQ(&*std::next(inserted), erased[3]);
+        REQUIRE_EQ(target.capacity(), 12);
+        REQUIRE_EQ(items_of(target), std::vector<int>{0, 2, 3, 4, 5, 7, 8, 11, 12, 13, 14, 14});
+        
+        auto const swept = std::max(addresses[0], addresses[11], std::less<int*>{});
+        auto const passed = std::min(addresses[0], addresses[11], std::less<int*>{});
+        target.erase(std::find(target.begin(), target.end(), 0));
+        target.erase(std::find(target.begin(), target.end(), 11));
+        auto const next = std::less<int*>{}(erased[3], swept) ? swept : passed;
+        REQUIRE_EQ(&*target.insert(15), next);
+    }
+    
+    
+    SCENARIO("reuse erased nodes of the densest page") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        target.reuse_policy(etceteras::pyramid_reuse::densest_page);
+        auto addresses = std::vector<int*>{};
+        for(auto i = 0; i != 12; ++i)
+            addresses.push_back(&*target.insert(i));
+        for(auto const i: {8, 0, 10, 5, 1, 9})
+            target.erase(std::find(target.begin(), target.end(), i));
+        for(auto const i: {5, 0, 1, 8, 9, 10})
+            REQUIRE_EQ(&*target.insert(i), addresses[i]);
+        REQUIRE_EQ(target.capacity(), 12);
+        
+        target.reuse_policy(etceteras::pyramid_reuse::lifo);
+        target.erase(std::find(target.begin(), target.end(), 3));
+        target.erase(std::find(target.begin(), target.end(), 7));
+        REQUIRE_EQ(&*target.insert(7), addresses[7]);
+    }
+    
+    
+    SCENARIO("defragment") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        auto addresses = std::vector<int*>{};
+        for(auto i = 0; i != 12; ++i)
+            addresses.push_back(&*target.insert(i));
+        for(auto const i: {0, 9, 1, 5, 2, 10})
+            target.erase(std::find(target.begin(), target.end(), i));
+        REQUIRE_EQ(target.defragment(0), 0);
+        auto relocations = std::vector<std::pair<int*, int*>>{};
+        auto const moved = target.defragment(10, [&](int* from, int* to) { relocations.emplace_back(from, to); });
+        REQUIRE_EQ(moved, 1);
+        REQUIRE_EQ(relocations.size(), 1);
+        REQUIRE_EQ(relocations[0].first, addresses[3]);
+        REQUIRE_EQ(relocations[0].second, addresses[5]);
+        REQUIRE_EQ(*relocations[0].second, 3);
+        REQUIRE_EQ(items_of(target), std::vector<int>{3, 4, 6, 7, 8, 11});
+        REQUIRE_EQ(target.defragment(), 0);
+        
+        auto const lowest = std::min(addresses[0], addresses[9], std::less<int*>{});
+        REQUIRE_EQ(&*target.insert(12), lowest);
+        target.erase(std::find(target.begin(), target.end(), 12));
+        target.shrink_to_fit();
+        REQUIRE_EQ(target.capacity(), 8);
+        REQUIRE_EQ(items_of(target), std::vector<int>{3, 4, 6, 7, 8, 11});
+    }
+    
+    
+    SCENARIO("defragment items that can not be moved") {
+        struct immovable {
+            int value;
+            explicit immovable(int value): value{value} { }
+            immovable(immovable const&) = delete;
+            immovable& operator = (immovable const&) = delete;
+        };
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<immovable, 16, growth>{};
+        auto addresses = std::vector<immovable*>{};
+        for(auto i = 0; i != 8; ++i)
+            addresses.push_back(&*target.emplace(i));
+        for(auto const i: {6, 1, 0, 7})
+            target.erase(std::find_if(target.begin(), target.end(), [i](auto const& item) { return item.value == i; }));
+        REQUIRE_EQ(target.defragment(), 0);
+        auto erased = std::vector<immovable*>{addresses[6], addresses[1], addresses[0], addresses[7]};
+        std::sort(erased.begin(), erased.end(), std::less<immovable*>{});
+        for(auto i = 0; i != 4; ++i)
+            REQUIRE_EQ(&*target.emplace(i), erased[i]);
+    }
+    
+    
+    SCENARIO("emplace") {
+        struct immovable {
+            int first;
+            std::string second;
+            immovable(int first, char const* second): first{first}, second{second} { }
+            immovable(immovable const&) = delete;
+            immovable& operator = (immovable const&) = delete;
+        };
+        auto target = etceteras::pyramid<immovable>{};
+        auto it = target.emplace(1, "one");
+        REQUIRE_EQ(target.size(), 1);
+        REQUIRE_EQ(it->first, 1);
+        REQUIRE_EQ(it->second, "one");
+        target.emplace(2, "two");
+        REQUIRE_EQ((--target.end())->second, "two");
+    }
+    
+    
+    SCENARIO("emplace with throwing constructor") {
+        struct throwing {
+            int value;
+            explicit throwing(int value): value{value} {
+                if(value < 0)
+                    throw value;
+            }
+        };
+        auto target = etceteras::pyramid<throwing>{};
+        target.emplace(1);
+        auto* erased = &*target.emplace(2);
+        target.emplace(3);
+        target.erase(++target.begin());
+        REQUIRE_THROWS_AS(target.emplace(-1), int);
+        REQUIRE_EQ(target.size(), 2);
+        REQUIRE_EQ(target.begin()->value, 1);
+        REQUIRE_EQ((++target.begin())->value, 3);
+        REQUIRE_EQ(&*target.emplace(4), erased);
+        auto const capacity = target.capacity();
+        while(target.size() != capacity)
+            target.emplace(5);
+        REQUIRE_THROWS_AS(target.emplace(-1), int);
+        REQUIRE_EQ(target.size(), capacity);
+        REQUIRE_EQ((--target.end())->value, 5);
+        target.emplace(6);
+        REQUIRE_EQ((--target.end())->value, 6);
+    }
+    
+    
+    SCENARIO("insert range") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        target.insert({1, 2, 3});
+        target.erase(target.begin());
+        target.erase(target.begin());
+        auto const source = std::vector<int>{4, 5, 6, 7, 8, 9, 10};
+        auto it = target.insert(source.begin(), source.end());
+        REQUIRE_EQ(*it, 4);
+        REQUIRE_EQ(target.size(), 8);
+        REQUIRE_EQ(target.capacity(), 8);
+        REQUIRE_EQ(items_of(target), std::vector<int>{3, 4, 5, 6, 7, 8, 9, 10});
+        REQUIRE_EQ(target.insert(source.end(), source.end()), target.end());
+        auto copy = etceteras::pyramid<int, 16, growth>{};
+        copy.insert(target.begin(), target.end());
+        REQUIRE_EQ(items_of(copy), items_of(target));
+    }
+    
+    
+    SCENARIO("insert range from input iterators") {
+        auto target = etceteras::pyramid<int>{};
+        auto stream = std::istringstream{"1 2 3"};
+        auto it = target.insert(std::istream_iterator<int>{stream}, std::istream_iterator<int>{});
+        REQUIRE_EQ(*it, 1);
+        REQUIRE_EQ(items_of(target), std::vector<int>{1, 2, 3});
+    }
+    
+    
+    SCENARIO("insert copies") {
+        auto target = etceteras::pyramid<std::string>{};
+        target.insert("first");
+        auto it = target.insert_n(3, "copy");
+        REQUIRE_EQ(*it, "copy");
+        REQUIRE_EQ(items_of(target), std::vector<std::string>{"first", "copy", "copy", "copy"});
+        REQUIRE_EQ(target.insert_n(0, "none"), target.end());
+    }
+    
+    
+    SCENARIO("insert range with throwing constructor") {
+        struct throwing {
+            int value;
+            throwing(int value): value{value} {
+                if(value < 0)
+                    throw value;
+            }
+        };
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::pyramid<throwing, 16, growth>{};
+        target.insert_n(3, throwing{1});
+        target.erase(target.begin());
+        auto const source = std::vector<int>{2, 3, 4, -1, 5};
+        REQUIRE_THROWS_AS(target.insert(source.begin(), source.end()), int);
+        REQUIRE_EQ(target.size(), 2);
+        auto stream = std::istringstream{"2 3 4 -1 5"};
+        REQUIRE_THROWS_AS(target.insert(std::istream_iterator<int>{stream}, std::istream_iterator<int>{}), int);
+        REQUIRE_EQ(target.size(), 2);
+        auto const good = std::vector<int>{2, 3, 4, 5, 6, 7};
+        target.insert(good.begin(), good.end());
+        auto values = std::vector<int>{};
+        for(auto const& item: target)
+            values.push_back(item.value);
+        REQUIRE_EQ(values, std::vector<int>{1, 1, 2, 3, 4, 5, 6, 7});
+        REQUIRE_EQ(target.capacity(), 8);
+    }
+    
+    
+    SCENARIO("insert range with throwing iterator") {
+        struct counted {
+            int* alive;
+            counted(int* alive): alive{alive} { ++*alive; }
+            counted(counted const& other): alive{other.alive} { ++*alive; }
+            ~counted() { --*alive; }
+        };
+        auto alive = 0;
+        int* const source[] = {&alive, &alive, &alive, &alive};
+        {
+            auto target = etceteras::pyramid<counted>{};
+            target.emplace(&alive);
+            auto steps = 4 + 2;  // distance takes 4, the third item is constructed before throw
+            auto const first = throwing_iterator{source, &steps};
+            auto const last = throwing_iterator{source + 4, &steps};
+            REQUIRE_THROWS_AS(target.insert(first, last), int);
+            REQUIRE_EQ(target.size(), 1);
+            REQUIRE_EQ(alive, 1);
+        }
+        REQUIRE_EQ(alive, 0);
+    }
+    
+    
+    SCENARIO("iterator to item and erase by address") {
+        struct registered;
+        using registry = etceteras::pyramid<registered>;
+        struct registered {
+            registry* owner;
+            int value;
+            void unregister() { owner->erase(this); }
+        };
+        auto target = registry{};
+        for(auto i = 0; i != 5; ++i)
+            target.insert(registered{&target, i});
+        auto& third = *std::next(target.begin(), 2);
+        REQUIRE_EQ(target.iterator_to(third), std::next(target.begin(), 2));
+        auto const& constant = target;
+        REQUIRE_EQ(constant.iterator_to(third)->value, 2);
+        third.unregister();
+        REQUIRE_EQ(target.size(), 4);
+        REQUIRE_EQ(std::next(target.begin(), 2)->value, 3);
+        REQUIRE_EQ(target.erase(&*target.begin())->value, 1);
+        
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        using split_pyramid = etceteras::pyramid<int, 16, growth, std::allocator<int>, etceteras::pyramid_layout::split>;
+        using compact_pyramid = etceteras::pyramid<int, 16, growth, std::allocator<int>, etceteras::pyramid_layout::compact>;
+        auto split = split_pyramid{};
+        auto compact = compact_pyramid{};
+        for(auto i = 0; i != 10; ++i) {
+            split.insert(i);
+            compact.insert(i);
+        }
+        for(auto i = 0; i != 10; ++i) {
+            REQUIRE_EQ(split.iterator_to(*std::next(split.begin(), i)), std::next(split.begin(), i));
+            REQUIRE_EQ(compact.iterator_to(*std::next(compact.begin(), i)), std::next(compact.begin(), i));
+        }
+        split.erase(&*std::next(split.begin(), 5));
+        compact.erase(&*std::next(compact.begin(), 5));
+        REQUIRE_EQ(items_of(split), std::vector<int>{0, 1, 2, 3, 4, 6, 7, 8, 9});
+        REQUIRE_EQ(items_of(compact), std::vector<int>{0, 1, 2, 3, 4, 6, 7, 8, 9});
+    }
+    
+    
+    SCENARIO("remote erase") {
+        using shared_pyramid = etceteras::pyramid<int, 16, etceteras::pyramid_growth::fixed<8>,
+                                                  std::allocator<int>, etceteras::pyramid_layout::shared>;
+        auto target = shared_pyramid{};
+        for(auto i = 0; i != 10; ++i)
+            target.insert(i);
+        target.remote_erase(std::next(target.begin(), 2));
+        target.remote_erase(std::next(target.begin(), 7));
+        REQUIRE_EQ(target.size(), 10);
+        REQUIRE_EQ(target.collect_returned(), 2);
+        REQUIRE_EQ(target.collect_returned(), 0);
+        REQUIRE_EQ(items_of(target), std::vector<int>{0, 1, 3, 4, 5, 6, 8, 9});
+        
+        target.remote_erase(target.begin());
+        auto const capacity = target.capacity();
+        target.insert(10);
+        target.insert(11);
+        target.insert(12);
+        REQUIRE_EQ(target.capacity(), capacity);
+        REQUIRE_EQ(items_of(target), std::vector<int>{1, 3, 4, 5, 6, 8, 9, 10, 11, 12});
+        REQUIRE_EQ(target.iterator_to(*target.begin()), target.begin());
+    }
+    
+    
+    SCENARIO("remote erase by other threads") {
+        using shared_pyramid = etceteras::pyramid<int, 16, etceteras::pyramid_growth::fixed<64>,
+                                                  std::allocator<int>, etceteras::pyramid_layout::shared>;
+        auto target = shared_pyramid{};
+        auto constexpr threads = 4;
+        auto constexpr items = 2000;
+        auto handed = std::vector<std::vector<shared_pyramid::const_iterator>>(threads);
+        for(auto i = 0; i != items * threads; ++i) {
+            auto const it = target.insert(i);
+            if(i % 2 == 0)
+                handed[i / 2 % threads].push_back(it);
+        }
+        auto workers = std::vector<std::thread>{};
+        for(auto t = 0; t != threads; ++t)
+            workers.emplace_back([&target, &handed, t] {
+                for(auto it: handed[t])
+                    target.remote_erase(it);
+            });
+        // Owner goes on inserting meanwhile
+        for(auto i = 0; i != items; ++i)
+            target.insert(items * threads + i);
+        for(auto& worker: workers)
+            worker.join();
+        target.collect_returned();
+        
+        auto expected = std::vector<int>{};
+        for(auto i = 1; i < items * threads; i += 2)
+            expected.push_back(i);
+        for(auto i = 0; i != items; ++i)
+            expected.push_back(items * threads + i);
+        REQUIRE_EQ(target.size(), expected.size());
+        REQUIRE_EQ(items_of(target), expected);
+    }
+    
+    
+    SCENARIO("erase range") {
+        auto target = etceteras::pyramid<int>{};
+        target.insert({1, 2, 3, 4, 5});
+        auto first = ++target.begin();
+        auto last = first;
+        ++++++last;
+        auto it = target.erase(first, last);
+        REQUIRE_EQ(*it, 5);
+        REQUIRE_EQ(target.size(), 2);
+        REQUIRE_EQ(items_of(target), std::vector<int>{1, 5});
+        REQUIRE_EQ(target.erase(it, it), it);
+        target.insert({6, 7, 8, 9});
+        REQUIRE_EQ(target.capacity(), 16);
+        REQUIRE_EQ(items_of(target), std::vector<int>{1, 5, 6, 7, 8, 9});
+        target.erase(target.begin(), target.end());
+        REQUIRE(target.empty());
+        REQUIRE_EQ(target.begin(), target.end());
+    }
+    
+    
+    SCENARIO("erase if") {
+        auto target = etceteras::pyramid<int>{};
+        for(auto i = 0; i != 10; ++i)
+            target.insert(i);
+        auto const erased = target.erase_if([](int item) { return item % 3 == 0; });
+        REQUIRE_EQ(erased, 4);
+        REQUIRE_EQ(items_of(target), std::vector<int>{1, 2, 4, 5, 7, 8});
+        target.insert_n(4, 10);
+        REQUIRE_EQ(target.capacity(), 16);
+        REQUIRE_EQ(target.erase_if([](int) { return false; }), 0);
+        REQUIRE_EQ(target.size(), 10);
+    }
+    
+    
+    SCENARIO("copy ordered pages") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto source = etceteras::pyramid<int, 16, growth>{};
+        source.reserve(10);
+        for(auto i = 0; i != 10; ++i)
+            source.insert(i);
+        source.reserve(12);
+        auto target = source;
+        REQUIRE_EQ(target.size(), 10);
+        REQUIRE_EQ(target.capacity(), 12);
+        REQUIRE_EQ(items_of(target), items_of(source));
+        REQUIRE_EQ(*--target.end(), 9);
+        target.insert(10);
+        target.erase(target.begin());
+        REQUIRE_EQ(*target.begin(), 1);
+        REQUIRE_EQ(*--target.end(), 10);
+    }
+    
+    
+    SCENARIO("copy fragmented pages") {
+        auto source = etceteras::pyramid<int>{};
+        for(auto i = 0; i != 20; ++i)
+            source.insert(i);
+        source.erase_if([](int item) { return item % 2 == 0; });
+        source.insert(20);
+        auto const target = source;
+        REQUIRE_EQ(items_of(target), items_of(source));
+        REQUIRE_EQ(*--target.end(), 20);
+    }
+    
+    
+    SCENARIO("destroy items on clear") {
+        struct counted {
+            int* destroyed;
+            ~counted() { ++*destroyed; }
+        };
+        auto destroyed = 0;
+        auto target = etceteras::pyramid<counted>{};
+        for(auto i = 0; i != 5; ++i)
+            target.emplace(counted{&destroyed});
+        destroyed = 0;
+        target.erase(target.begin());
+        REQUIRE_EQ(destroyed, 1);
+        target.clear();
+        REQUIRE_EQ(destroyed, 5);
+    }
+    
+    
+    SCENARIO("for each unordered") {
+        using growth = etceteras::pyramid_growth::fixed<100>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        for(auto i = 0; i != 250; ++i)
+            target.insert(i);
+        target.erase_if([](int item) { return item % 3 == 0 || (item >= 100 && item < 200); });
+        target.erase(target.begin());
+        target.insert_n(2, 1000);
+        auto visited = std::vector<int>{};
+        target.for_each_unordered([&](int& item) { visited.push_back(item); });
+        auto expected = items_of(target);
+        std::sort(visited.begin(), visited.end());
+        std::sort(expected.begin(), expected.end());
+        REQUIRE_EQ(visited, expected);
+        
+        auto const& constant = target;
+        auto sum = 0;
+        constant.for_each_unordered([&](int const& item) { sum += item; });
+        REQUIRE_EQ(sum, std::accumulate(expected.begin(), expected.end(), 0));
+        
+        auto source = etceteras::pyramid<int, 16, growth>{};
+        source.insert({1, 2, 3});
+        auto const copy = source;
+        visited.clear();
+        copy.for_each_unordered([&](int item) { visited.push_back(item); });
+        REQUIRE_EQ(visited, std::vector<int>{1, 2, 3});
+    }
+    
+    
+    SCENARIO("for each interleaved") {
+        using growth = etceteras::pyramid_growth::fixed<100>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        auto visited = std::vector<int>{};
+        target.for_each_interleaved([&](int item) { visited.push_back(item); });
+        REQUIRE(visited.empty());
+        for(auto i = 0; i != 250; ++i)
+            target.insert(i);
+        target.erase_if([](int item) { return item % 3 == 0 || (item >= 100 && item < 200); });
+        target.insert_n(20, 1000);
+        target.for_each_interleaved<1>([&](int item) { visited.push_back(item); });
+        REQUIRE_EQ(visited, items_of(target));
+        
+        visited.clear();
+        target.for_each_interleaved([&](int& item) { visited.push_back(item); });
+        auto expected = items_of(target);
+        std::sort(visited.begin(), visited.end());
+        std::sort(expected.begin(), expected.end());
+        REQUIRE_EQ(visited, expected);
+        
+        auto const& constant = target;
+        visited.clear();
+        constant.for_each_interleaved<64>([&](int const& item) { visited.push_back(item); });
+        std::sort(visited.begin(), visited.end());
+        REQUIRE_EQ(visited, expected);
+    }
+    
+    
+    SCENARIO("for each run") {
+        using growth = etceteras::pyramid_growth::fixed<100>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        for(auto i = 0; i != 250; ++i)
+            target.insert(i);
+        target.erase_if([](int item) { return item % 7 < 2 || (item >= 100 && item < 200) || item == 243; });
+        auto visited = std::vector<int>{};
+        auto runs = std::vector<etceteras::strided_span<int>>{};
+        target.for_each_run([&](etceteras::strided_span<int> run) {
+            REQUIRE_FALSE(run.empty());
+            REQUIRE_EQ(run.stride(), sizeof(etceteras::detail::pyramid_node<int>));
+            for(auto i = std::size_t{0}; i != run.size(); ++i)
+                visited.push_back(run[i]);
+            runs.push_back(run);
+        });
+        // Runs follow page addresses, which need not ascend with page order
+        auto expected = items_of(target);
+        std::sort(expected.begin(), expected.end());
+        std::sort(visited.begin(), visited.end());
+        REQUIRE_EQ(visited, expected);
+        REQUIRE_EQ(runs.size(), 14 + 9);
+        for(auto i = std::size_t{1}; i != runs.size(); ++i)
+            REQUIRE_NE(&runs[i - 1][runs[i - 1].size()], runs[i].data());
+        
+        auto const& constant = target;
+        auto sum = std::size_t{0};
+        constant.for_each_run([&](etceteras::strided_span<int const> run) { sum += run.size(); });
+        REQUIRE_EQ(sum, target.size());
+    }
+    
+    
+    SCENARIO("split layout") {
+        using growth = etceteras::pyramid_growth::fixed<100>;
+        using split_pyramid = etceteras::pyramid<int, 16, growth, std::allocator<int>, etceteras::pyramid_layout::split>;
+        REQUIRE_EQ(sizeof(etceteras::detail::pyramid_link<int>), 2 * sizeof(void*));
+        auto target = split_pyramid{};
+        target.reserve(150, true);
+        for(auto i = 0; i != 250; ++i)
+            target.insert(i);
+        auto* first = &*target.begin();
+        REQUIRE_EQ(&*std::next(target.begin()), first + 1);
+        target.erase_if([](int item) { return item % 7 < 2; });
+        target.erase(target.begin());
+        target.insert_n(3, 1000);
+        auto expected = items_of(target);
+        
+        auto visited = std::vector<int>{};
+        target.for_each_run([&](etceteras::strided_span<int> run) {
+            REQUIRE(run.contiguous());
+            visited.insert(visited.end(), run.data(), run.data() + run.size());
+        });
+        auto unordered = std::vector<int>{};
+        target.for_each_unordered([&](int item) { unordered.push_back(item); });
+        REQUIRE_EQ(visited, unordered);
+        std::sort(visited.begin(), visited.end());
+        auto sorted = expected;
+        std::sort(sorted.begin(), sorted.end());
+        REQUIRE_EQ(visited, sorted);
+        
+        auto const copy = target;
+        REQUIRE_EQ(items_of(copy), expected);
+        auto ordered = split_pyramid{};
+        ordered.insert({1, 2, 3});
+        auto const ordered_copy = ordered;
+        REQUIRE_EQ(items_of(ordered_copy), (std::vector<int>{1, 2, 3}));
+        
+        auto const second = std::next(target.begin());
+        auto moved = std::move(target);
+        REQUIRE_EQ(items_of(moved), expected);
+        REQUIRE_EQ(*second, expected[1]);
+        auto swapped = split_pyramid{};
+        swapped.swap(moved);
+        REQUIRE_EQ(*second, expected[1]);
+        REQUIRE_EQ(std::next(swapped.begin()), second);
+    }
+    
+    
+    SCENARIO("prefault split pages in use") {
+        using growth = etceteras::pyramid_growth::fixed<1000>;
+        using split_pyramid = etceteras::pyramid<int, 16, growth, std::allocator<int>, etceteras::pyramid_layout::split>;
+        for(auto filled = 1; filled < 1000; filled += 37) {
+            auto target = split_pyramid{};
+            for(auto i = 0; i != filled; ++i)
+                target.insert(i + 1);
+            target.erase(target.begin());
+            auto const expected = items_of(target);
+            target.reserve(3000, true);
+            REQUIRE_EQ(items_of(target), expected);
+            auto visited = std::size_t{0};
+            target.for_each_run([&](etceteras::strided_span<int> run) {
+                REQUIRE_FALSE(run.empty());
+                visited += run.size();
+            });
+            REQUIRE_EQ(visited, target.size());
+        }
+    }
+    
+    
+    SCENARIO("split layout of aligned and non trivial items") {
+        struct alignas(32) aligned {
+            int value;
+        };
+        auto target = etceteras::pyramid<aligned, 16, etceteras::pyramid_growth::geometric<16>,
+                                         std::allocator<aligned>, etceteras::pyramid_layout::split>{};
+        for(auto i = 0; i != 100; ++i)
+            REQUIRE_EQ(reinterpret_cast<std::uintptr_t>(&*target.insert(aligned{i})) % 32, 0);
+        
+        auto strings = etceteras::pmr::pyramid<std::pmr::string, 16, etceteras::pyramid_growth::geometric<16>,
+                                               etceteras::pyramid_layout::split>{};
+        for(auto i = 0; i != 50; ++i)
+            strings.insert(std::pmr::string(40, char('a' + i % 26)));
+        strings.erase(strings.begin());
+        auto const copy = strings;
+        REQUIRE_EQ(copy.size(), 49);
+        REQUIRE_EQ(*copy.begin(), std::pmr::string(40, 'b'));
+    }
+    
+    
+    SCENARIO("compact layout") {
+        using growth = etceteras::pyramid_growth::fixed<100>;
+        using compact_pyramid = etceteras::pyramid<std::uint64_t, 16, growth, std::allocator<std::uint64_t>,
+                                                   etceteras::pyramid_layout::compact>;
+        REQUIRE_EQ(sizeof(etceteras::detail::pyramid_compact_node<std::uint64_t>), 16);
+        auto target = compact_pyramid{};
+        REQUIRE_EQ(target.max_size(), 4094 * 100);
+        REQUIRE(target.begin() == target.end());
+        for(auto i = std::uint64_t{0}; i != 250; ++i)
+            target.insert(i);
+        target.erase_if([](std::uint64_t item) { return item % 7 < 2; });
+        target.erase(target.begin());
+        target.erase(std::next(target.begin(), 10), std::next(target.begin(), 20));
+        target.insert_n(3, 1000);
+        target.emplace(std::uint64_t{2000});
+        auto expected = items_of(target);
+        REQUIRE_EQ(expected.size(), target.size());
+        REQUIRE_EQ(*--target.end(), 2000);
+        REQUIRE_EQ(*target.begin(), 3);
+        
+        auto const copy = target;
+        REQUIRE_EQ(items_of(copy), expected);
+        auto moved = std::move(target);
+        REQUIRE_EQ(items_of(moved), expected);
+        REQUIRE(target.empty());
+        target.insert(1);
+        swap(target, moved);
+        REQUIRE_EQ(items_of(target), expected);
+        REQUIRE_EQ(items_of(moved), std::vector<std::uint64_t>{1});
+        
+        target.release_watermark(0);
+        target.erase(target.begin(), target.end());
+        REQUIRE_EQ(target.capacity(), 0);
+        target.insert({1, 2, 3});
+        REQUIRE_EQ(items_of(target), (std::vector<std::uint64_t>{1, 2, 3}));
+    }
+    
+    
+    SCENARIO("compact layout limits") {
+        using compact_pyramid = etceteras::pyramid<int, 16, etceteras::pyramid_growth::geometric<16>,
+                                                   std::allocator<int>, etceteras::pyramid_layout::compact>;
+        auto large = compact_pyramid{};
+        large.reserve(std::size_t{3} << 20);
+        REQUIRE_GE(large.capacity(), std::size_t{3} << 20);
+        
+        using tiny_pyramid = etceteras::pyramid<int, 16, etceteras::pyramid_growth::fixed<1>,
+                                                std::allocator<int>, etceteras::pyramid_layout::compact>;
+        auto tiny = tiny_pyramid{};
+        for(auto i = 0; i != 4094; ++i)
+            tiny.insert(i);
+        REQUIRE_THROWS_AS(tiny.insert(4094), std::length_error);
+        tiny.erase(tiny.begin());
+        tiny.insert(4094);
+        REQUIRE_EQ(*--tiny.end(), 4094);
+        REQUIRE_EQ(tiny.size(), 4094);
+        REQUIRE_EQ(tiny.max_size(), 4094);
+        
+        using small_pyramid = etceteras::pyramid<long, 16, etceteras::pyramid_growth::fixed<16>,
+                                                 std::allocator<long>, etceteras::pyramid_layout::compact>;
+        auto small = small_pyramid{};
+        REQUIRE_EQ(small.max_size(), 4094 * 16);
+        small.insert_n(small.max_size(), 1);
+        REQUIRE_EQ(small.size(), small.max_size());
+        REQUIRE_THROWS_AS(small.insert(2), std::length_error);
+        // Five geometric pages make 2^20 nodes, the rest are capped by 2^20 each
+        REQUIRE_EQ(large.max_size(), std::size_t{4090} << 20);
+    }
+    
+    
+    SCENARIO("generational handles") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        using generational_pyramid = etceteras::pyramid<int, 16, growth,
+                                                        std::allocator<int>, etceteras::pyramid_layout::generational>;
+        auto target = generational_pyramid{};
+        REQUIRE_EQ(target.get(etceteras::pyramid_handle{std::uint64_t{1} << 32 | 2 << 20}), nullptr);
+        auto handles = std::vector<etceteras::pyramid_handle>{};
+        for(auto i = 0; i != 10; ++i)
+            handles.push_back(target.handle_of(target.insert(i)));
+        for(auto i = 0; i != 10; ++i)
+            REQUIRE_EQ(*target.get(handles[i]), i);
+        REQUIRE(target.erase(handles[3]));
+        REQUIRE_FALSE(target.erase(handles[3]));
+        REQUIRE_EQ(target.get(handles[3]), nullptr);
+        auto const reused = target.handle_of(target.insert(10));
+        REQUIRE_EQ(reused.value & 0xFFFFFFFF, handles[3].value & 0xFFFFFFFF);
+        REQUIRE_NE(reused, handles[3]);
+        REQUIRE_EQ(target.get(handles[3]), nullptr);
+        REQUIRE_EQ(*target.get(reused), 10);
+        REQUIRE_EQ(target.get(etceteras::pyramid_handle{handles[9].value + 2}), nullptr);
+        REQUIRE_EQ(target.get(etceteras::pyramid_handle{handles[0].value & 0xFFFFFFFF}), nullptr);
+        
+        target.erase_if([](int item) { return item < 2; });
+        target.insert_n(2, 11);
+        REQUIRE_EQ(target.get(handles[0]), nullptr);
+        REQUIRE_EQ(target.get(handles[1]), nullptr);
+        REQUIRE_EQ(*target.get(target.handle_of(target.begin())), 2);
+        
+        auto const& constant = target;
+        REQUIRE_EQ(*constant.get(handles[9]), 9);
+        auto const last = handles[9];
+        target.clear();
+        REQUIRE_EQ(target.get(last), nullptr);
+        for(auto i = 0; i != 10; ++i)
+            target.insert(i);
+        REQUIRE_EQ(target.get(last), nullptr);
+        REQUIRE_EQ(target.size(), 10);
+    }
+    
+    
+    SCENARIO("geometric growth capped by page size") {
+        using growth = etceteras::pyramid_growth::geometric<4, 8>;
+        auto target = etceteras::pyramid<int, 4, growth>{};
+        auto capacities = std::vector<std::size_t>{};
+        for(auto i = 0; i != 30; ++i) {
+            target.insert(i);
+            if(capacities.empty() || capacities.back() != target.capacity())
+                capacities.push_back(target.capacity());
+        }
+        REQUIRE_EQ(capacities, std::vector<std::size_t>{4, 12, 20, 28, 36});
+    }
+    
+    
+    SCENARIO("linear growth") {
+        using growth = etceteras::pyramid_growth::linear<2, 3>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        auto capacities = std::vector<std::size_t>{};
+        for(auto i = 0; i != 20; ++i) {
+            target.insert(i);
+            if(capacities.empty() || capacities.back() != target.capacity())
+                capacities.push_back(target.capacity());
+        }
+        REQUIRE_EQ(capacities, std::vector<std::size_t>{2, 7, 15, 26});
+    }
+    
+    
+    SCENARIO("growth after move") {
+        using pyramid = etceteras::pyramid<int, 16, etceteras::pyramid_growth::linear<10>>;
+        // Growth starts from the first page as if nothing was moved
+        alignas(pyramid) unsigned char storage[sizeof(pyramid)];
+        auto source = pyramid{};
+        std::iota(std::begin(storage), std::end(storage), static_cast<unsigned char>(1));
+        auto* target = new(storage) pyramid{std::move(source)};
+        target->insert(1);
+        REQUIRE_EQ(target->capacity(), 10);
+        target->insert_n(10, 2);
+        REQUIRE_EQ(target->capacity(), 30);
+        target->~pyramid();
+    }
+    
+    
+    SCENARIO("fixed growth") {
+        using growth = etceteras::pyramid_growth::fixed<5>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        for(auto i = 0; i != 11; ++i)
+            target.insert(i);
+        REQUIRE_EQ(target.capacity(), 15);
+        auto expected = 0;
+        for(auto const item: target)
+            REQUIRE_EQ(item, expected++);
+    }
+    
+    
+    SCENARIO("rounded growth") {
+        using growth = etceteras::pyramid_growth::rounded<etceteras::pyramid_growth::fixed<10>, 4096>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        target.insert(0);
+        auto const node_size = sizeof(etceteras::detail::pyramid_node<int>);
+        auto const page_overhead = sizeof(etceteras::detail::pyramid_page<int>) - node_size;
+        auto const context = etceteras::pyramid_growth::context{0, 0, node_size, page_overhead};
+        REQUIRE_LE(etceteras::pyramid_growth::page_bytes(context, target.capacity()), 4096);
+        REQUIRE_GT(etceteras::pyramid_growth::page_bytes(context, target.capacity() + 1), 4096);
+    }
+    
+    
+    SCENARIO("budgeted growth") {
+        using growth = etceteras::pyramid_growth::budgeted<4096>;
+        auto target = etceteras::pyramid<int, 16, growth>{};
+        target.insert(0);
+        auto const capacity = target.capacity();
+        REQUIRE_GT(capacity, 1);
+        REQUIRE_LE(capacity * sizeof(etceteras::detail::pyramid_node<int>), 4096);
+        for(auto i = std::size_t{0}; i != capacity; ++i)
+            target.insert(1);
+        REQUIRE_EQ(target.capacity(), capacity * 2);
+    }
 
 
     
@@ -0,0 +1,125 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <etceteras/sharded_pyramid.hpp>
+
+
+TEST_SUITE("sharded_pyramid") {
+    
+    
+    SCENARIO("sharded insert by key and erase") {
+        auto target = etceteras::sharded_pyramid<int, 4>{};
+        REQUIRE(target.empty());
+        REQUIRE(target.begin() == target.end());
+        auto iterators = std::vector<etceteras::sharded_pyramid<int, 4>::iterator>{};
+        for(auto i = 0; i != 20; ++i)
+            iterators.push_back(target.emplace_keyed(std::size_t(i), i));
+        REQUIRE_EQ(target.size(), 20);
+        for(auto i = 0; i != 20; ++i) {
+            REQUIRE_EQ(iterators[i].shard_index(), std::size_t(i % 4));
+            REQUIRE_EQ(*iterators[i], i);
+        }
+        
+        // Shards are visited one after another in insertion order of each
+        auto visited = std::vector<int>{target.begin(), target.end()};
+        auto expected = std::vector<int>{};
+        for(auto shard = 0; shard != 4; ++shard)
+            for(auto i = shard; i < 20; i += 4)
+                expected.push_back(i);
+        REQUIRE_EQ(visited, expected);
+        
+        for(auto i = 0; i != 20; ++i)
+            if(i % 4 == 1 || i % 5 == 0)
+                target.erase(iterators[i]);
+        expected.erase(std::remove_if(expected.begin(), expected.end(),
+                                      [](int item) { return item % 4 == 1 || item % 5 == 0; }),
+                       expected.end());
+        auto const& constant = target;
+        REQUIRE_EQ(std::vector<int>{constant.begin(), constant.end()}, expected);
+        REQUIRE_EQ(target.shard_at(1).size(), 0);
+        
+        target.clear();
+        REQUIRE(target.empty());
+        REQUIRE(target.begin() == target.end());
+    }
+    
+    
+    SCENARIO("sharded insert and erase by many threads") {
+        auto target = etceteras::sharded_pyramid<int, 8>{};
+        auto constexpr threads = 4;
+        auto constexpr items = 3000;
+        auto kept = std::vector<std::vector<etceteras::sharded_pyramid<int, 8>::iterator>>(threads);
+        auto workers = std::vector<std::thread>{};
+        for(auto t = 0; t != threads; ++t)
+            workers.emplace_back([&target, &kept, t] {
+                for(auto i = 0; i != items; ++i) {
+                    auto const it = target.insert(t * items + i);
+                    if(i % 3 == 0)
+                        target.erase(it);
+                    else
+                        kept[t].push_back(it);
+                }
+            });
+        for(auto& worker: workers)
+            worker.join();
+        REQUIRE_EQ(target.size(), threads * (items - items / 3));
+        
+        auto sum = std::atomic<long long>{0};
+        auto expected = 0ll;
+        for(auto const& own: kept)
+            for(auto it: own)
+                expected += *it;
+        target.for_each([&sum](int item) { sum += item; }, 3);
+        REQUIRE_EQ(sum.load(), expected);
+        
+        // Items are erased by other threads than those inserted them
+        workers.clear();
+        for(auto t = 0; t != threads; ++t)
+            workers.emplace_back([&target, &kept, t] {
+                for(auto it: kept[(t + 1) % threads])
+                    target.erase(it);
+            });
+        for(auto& worker: workers)
+            worker.join();
+        REQUIRE(target.empty());
+    }
+    
+    
+    SCENARIO("sharded for each rethrows") {
+        auto target = etceteras::sharded_pyramid<int, 4>{};
+        for(auto i = 0; i != 40; ++i)
+            target.emplace_keyed(std::size_t(i), i);
+        auto visited = std::vector<int>{};
+        auto visited_lock = std::mutex{};
+        REQUIRE_THROWS_AS(target.for_each([&](int item) {
+                              if(item == 13)
+                                  throw std::runtime_error{"unlucky"};
+                              auto const lock = std::lock_guard<std::mutex>{visited_lock};
+                              visited.push_back(item);
+                          }, 2),
+                          std::runtime_error);
+        // Other shards are visited in full, the failed one up to 13
+        REQUIRE_EQ(visited.size(), 30 + 3);
+        
+        visited.clear();
+        std::as_const(target).for_each([&](int const& item) {
+            auto const lock = std::lock_guard<std::mutex>{visited_lock};
+            visited.push_back(item);
+        }, 1);
+        std::sort(visited.begin(), visited.end());
+        REQUIRE_EQ(visited.size(), 40);
+        REQUIRE_EQ(visited.front(), 0);
+        REQUIRE_EQ(visited.back(), 39);
+    }
+
+
+}
@@ -1,5 +1,11 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
+#include "concurrent_pyramid.test.hpp"
+#include "epoch_pyramid.test.hpp"
 #include "expected.test.hpp"
+#include "huge_pages.test.hpp"
+#include "parallel_pyramid.test.hpp"
 #include "pyramid.test.hpp"
+#include "sharded_pyramid.test.hpp"
+#include "unordered_pyramid.test.hpp"
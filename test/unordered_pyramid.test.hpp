@@ -0,0 +1,178 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <etceteras/unordered_pyramid.hpp>
+
+
+namespace {
+    
+    
+    template<typename P>
+    std::vector<typename P::value_type> sorted_items_of(P const& pyramid) {
+        auto items = std::vector<typename P::value_type>{};
+        for(auto const& item: pyramid)
+            items.push_back(item);
+        std::sort(items.begin(), items.end());
+        return items;
+    }
+    
+    
+} // namespace
+
+
+TEST_SUITE("unordered_pyramid") {
+    
+    
+    SCENARIO("unordered insert and erase") {
+        REQUIRE_EQ(sizeof(etceteras::detail::pyramid_slot<std::uint64_t>), sizeof(std::uint64_t));
+        using growth = etceteras::pyramid_growth::fixed<10>;
+        auto target = etceteras::unordered_pyramid<int, 16, growth>{};
+        REQUIRE(target.begin() == target.end());
+        auto addresses = std::vector<int*>{};
+        for(auto i = 0; i != 35; ++i)
+            addresses.push_back(&*target.insert(i));
+        REQUIRE_EQ(target.size(), 35);
+        REQUIRE_EQ(target.capacity(), 40);
+        auto expected = std::vector<int>{};
+        for(auto i = 0; i != 35; ++i)
+            expected.push_back(i);
+        REQUIRE_EQ(sorted_items_of(target), expected);
+        
+        auto it = target.begin();
+        while(it != target.end())
+            if(*it % 3 == 0 || (*it >= 10 && *it < 20))
+                it = target.erase(it);
+            else
+                ++it;
+        expected.erase(std::remove_if(expected.begin(), expected.end(),
+                                      [](int item) { return item % 3 == 0 || (item >= 10 && item < 20); }),
+                       expected.end());
+        REQUIRE_EQ(target.size(), expected.size());
+        REQUIRE_EQ(sorted_items_of(target), expected);
+        
+        auto const last_erased = addresses[33];
+        REQUIRE_EQ(&*target.insert(100), last_erased);
+        REQUIRE_EQ(*target.emplace(101), 101);
+        REQUIRE_EQ(target.capacity(), 40);
+    }
+    
+    
+    SCENARIO("unordered emplace with throwing constructor") {
+        struct fragile {
+            int value;
+            explicit fragile(int v): value{v} {
+                if(v < 0)
+                    throw std::runtime_error{"negative"};
+            }
+        };
+        auto target = etceteras::unordered_pyramid<fragile>{};
+        auto first = target.emplace(1);
+        target.emplace(2);
+        target.erase(first);
+        REQUIRE_THROWS_AS(target.emplace(-1), std::runtime_error);
+        REQUIRE_EQ(target.size(), 1);
+        REQUIRE_EQ(&*target.emplace(3), &*first);
+        REQUIRE_THROWS_AS(target.emplace(-1), std::runtime_error);
+        REQUIRE_EQ(target.emplace(4)->value, 4);
+        REQUIRE_EQ(target.size(), 3);
+    }
+    
+    
+    SCENARIO("unordered copy, move and shrink") {
+        using growth = etceteras::pyramid_growth::fixed<4>;
+        auto target = etceteras::unordered_pyramid<std::string, 16, growth>{};
+        for(auto i = 0; i != 12; ++i)
+            target.insert(std::string(20, char('a' + i)));
+        auto it = target.begin();
+        for(auto i = 0; i != 4; ++i)
+            it = target.erase(it);
+        auto const copy = target;
+        REQUIRE_EQ(sorted_items_of(copy), sorted_items_of(target));
+        
+        auto moved = std::move(target);
+        REQUIRE(target.empty());
+        REQUIRE_EQ(sorted_items_of(moved), sorted_items_of(copy));
+        swap(target, moved);
+        REQUIRE_EQ(sorted_items_of(target), sorted_items_of(copy));
+        
+        REQUIRE_EQ(target.capacity(), 12);
+        target.shrink_to_fit();
+        REQUIRE_EQ(target.capacity(), 8);
+        for(auto i = 0; i != 4; ++i)
+            target.insert(std::string(20, 'z'));
+        REQUIRE_EQ(target.capacity(), 12);
+        REQUIRE_EQ(target.size(), 12);
+        REQUIRE_EQ(std::count(target.begin(), target.end(), std::string(20, 'z')), 4);
+    }
+    
+    
+    SCENARIO("unordered move after reserve") {
+        using pyramid = etceteras::unordered_pyramid<int>;
+        // Moved into dirty storage, so nothing is left from the previous object
+        alignas(pyramid) unsigned char storage[sizeof(pyramid)];
+        auto source = pyramid{};
+        source.reserve(100);
+        source.allow_growth(false);
+        std::iota(std::begin(storage), std::end(storage), static_cast<unsigned char>(1));
+        auto* target = new(storage) pyramid{std::move(source)};
+        REQUIRE(!target->growth_allowed());
+        auto const capacity = target->capacity();
+        for(auto i = 0; i != 100; ++i)
+            target->insert(i);
+        REQUIRE_EQ(target->capacity(), capacity);
+        REQUIRE_EQ(target->size(), 100);
+        auto const copy = *target;
+        REQUIRE(!copy.growth_allowed());
+        target->~pyramid();
+    }
+    
+    
+    SCENARIO("unordered move between memory resources") {
+        using pyramid = etceteras::pmr::unordered_pyramid<int>;
+        auto first = std::pmr::unsynchronized_pool_resource{};
+        auto second = std::pmr::unsynchronized_pool_resource{};
+        auto source = pyramid{&first};
+        for(auto i = 0; i != 40; ++i)
+            source.insert(i);
+        source.allow_growth(false);
+        auto const expected = sorted_items_of(source);
+        auto target = pyramid{&second};
+        target.insert(100);
+        target = std::move(source);
+        REQUIRE(source.empty());
+        REQUIRE_EQ(target.get_allocator().resource(), &second);
+        REQUIRE_EQ(sorted_items_of(target), expected);
+        REQUIRE(!target.growth_allowed());
+        auto moved = pyramid{std::move(target), &first};
+        REQUIRE(target.empty());
+        REQUIRE_EQ(sorted_items_of(moved), expected);
+        REQUIRE(!moved.growth_allowed());
+        auto copy = pyramid{&second};
+        copy = moved;
+        REQUIRE_EQ(copy.get_allocator().resource(), &second);
+        REQUIRE_EQ(sorted_items_of(copy), expected);
+    }
+    
+    
+    SCENARIO("unordered pyramid from memory resource") {
+        auto target = etceteras::pmr::unordered_pyramid<std::pmr::string>{};
+        target.insert(std::pmr::string(40, 'x'));
+        REQUIRE_EQ(target.begin()->get_allocator().resource(), std::pmr::get_default_resource());
+        target.clear();
+        REQUIRE(target.empty());
+        REQUIRE_EQ(target.capacity(), 0);
+    }
+    
+    
+}